@@ -1,8 +1,6 @@
 #pragma once
 #include <WebSocketLibrary/WSClientSession.h>
-
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/json_parser.hpp>
+#include <WebSocketLibrary/WSJson.h>
 
 /*
 			Session flow
@@ -21,8 +19,8 @@
 		|	 Echo Data		|				|
 		|<------------------|				|
 		|					|  Transaction	|
-		| Send Keep-alive	|				|
-		|------------------>|				|
+		|	 Ping / Pong	|				|
+		|<----------------->|				|
 		|		...			|				|
 		|		...			|				|
 		|					|_______________|
@@ -43,11 +41,19 @@ namespace websocket {
 		std::string host_;
 		unsigned short port_;
 
+		std::chrono::milliseconds ping_interval_;
+		socket_options socket_options_;
+
+		compression_options compression_;
+		std::shared_ptr<compression_metrics> compression_metrics_;
+
 	public:
 		explicit WSClient(const std::string& host, unsigned short port)
 			: is_connected_(false)
 			, host_(host)
 			, port_(port)
+			, ping_interval_(default_ping_interval)
+			, compression_metrics_(std::make_shared<compression_metrics>())
 		{
 		}
 
@@ -62,6 +68,9 @@ namespace websocket {
 			if (!session_) {
 				return;
 			}
+			session_->set_ping_interval(ping_interval_);
+			session_->set_socket_options(socket_options_);
+			session_->set_compression(compression_, compression_metrics_);
 			session_->run(std::bind(
 				&WSClient::on_handshake_completed,
 				this, std::placeholders::_1));
@@ -77,6 +86,24 @@ namespace websocket {
 		void set_Key(const std::string& Key) {
 			Key_ = Key;
 		}
+
+		// Keepalive ping interval, zero disables it
+		void set_ping_interval(std::chrono::milliseconds interval) {
+			ping_interval_ = interval;
+		}
+
+		void set_socket_options(const socket_options& options) {
+			socket_options_ = options;
+		}
+
+		// Offer permessage-deflate, set before connect
+		void set_compression(const compression_options& options) {
+			compression_ = options;
+		}
+
+		std::shared_ptr<compression_metrics> get_compression_metrics() const {
+			return compression_metrics_;
+		}
 	private:
 		void on_handshake_completed(std::shared_ptr<tcp_session> session) {
 			session->send(get_Key_message(),
@@ -102,32 +129,23 @@ namespace websocket {
 			std::string&& received_data,
 			std::shared_ptr<tcp_session> session) {
 			// Parse send Key result
-			boost::property_tree::ptree tree;
-			std::stringstream ss(received_data);
-			boost::property_tree::json_parser::read_json(ss, tree);
-
-			try {
-				size_t status_code = tree.get<size_t>("status_code");
-				std::string message = tree.get<std::string>("message");
-
-				is_connected_ = status_code == 200 ? true : false;
-				if (!is_connected_) {
-					disconnect();
-				}
-			}
-			catch (...) {
+			json::value response = json::parse(received_data);
+			std::uint64_t status_code = 0;
+			if (!response["status_code"].get(status_code) || !response["message"].is_string()) {
 				log("parse Key response fail");
+				return;
+			}
+
+			is_connected_ = status_code == 200 ? true : false;
+			if (!is_connected_) {
+				disconnect();
 			}
 		}
 
 		std::string get_Key_message() {
-			boost::property_tree::ptree tree;
-			tree.add("Key", Key_);
-
-			std::stringstream ss;
-			boost::property_tree::json_parser::write_json(ss, tree);
-
-			return ss.str();
+			std::string message;
+			json::writer(message).begin_object().key("Key").string(Key_).end_object();
+			return message;
 		}
 		
 	};
@@ -0,0 +1,91 @@
+// Benchmark of MessageChannel broadcast, copy-on-write subscribers read
+// without a lock, against the former shared_mutex channel which copied
+// every callback per message. Each thread broadcasts on one shared channel
+// with 4 subscribers, reports broadcasts/s for 1 to 16 threads.
+#include "WSUtility.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	// MessageChannel before copy-on-write
+	template<typename T>
+	class shared_mutex_channel {
+		std::shared_mutex mutex_;
+		std::vector<T> subscribers_;
+	public:
+		void subscribe(T&& callback) {
+			std::lock_guard<std::shared_mutex> guard(mutex_);
+			subscribers_.emplace_back(std::move(callback));
+		}
+
+		template<typename T2>
+		void broadcast(T2&& data) {
+			std::shared_lock<std::shared_mutex> guard(mutex_);
+			for (auto cb : subscribers_) {
+				if (cb) {
+					cb(data);
+				}
+			}
+		}
+	};
+
+	const size_t subscriber_count = 4;
+	const size_t broadcasts_per_thread = 1000000;
+
+	// Thread local sinks, so the callbacks themselves share nothing
+	thread_local size_t delivered = 0;
+
+	template<typename Channel>
+	double broadcasts_per_second(Channel& channel, size_t thread_count) {
+		const std::string message(64, 'x');
+		std::atomic<bool> start(false);
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < thread_count; ++i) {
+			threads.emplace_back([&]() {
+				while (!start) {
+					std::this_thread::yield();
+				}
+				for (size_t n = 0; n < broadcasts_per_thread; ++n) {
+					channel.broadcast(message);
+				}
+			});
+		}
+
+		auto begin = std::chrono::steady_clock::now();
+		start = true;
+		for (auto& t : threads) {
+			t.join();
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		return thread_count * broadcasts_per_thread / seconds;
+	}
+
+	template<typename Channel>
+	void subscribe_all(Channel& channel) {
+		for (size_t i = 0; i < subscriber_count; ++i) {
+			channel.subscribe([](const std::string& data) { delivered += data.size(); });
+		}
+	}
+}
+
+int main() {
+	const size_t thread_counts[] = { 1, 2, 4, 8, 16 };
+
+	printf("%-8s %16s %16s\n", "threads", "shared_mutex/s", "copy-on-write/s");
+	for (size_t threads : thread_counts) {
+		shared_mutex_channel<websocket::CallbackHandler<std::string>> locked;
+		subscribe_all(locked);
+		websocket::Channel channel;
+		subscribe_all(channel);
+
+		double locked_rate = broadcasts_per_second(locked, threads);
+		double channel_rate = broadcasts_per_second(channel, threads);
+		printf("%-8zu %16.0f %16.0f\n", threads, locked_rate, channel_rate);
+	}
+	return 0;
+}
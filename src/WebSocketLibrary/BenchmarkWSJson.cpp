@@ -0,0 +1,113 @@
+// Benchmark of the key handshake JSON, WSJson against the property_tree
+// code it replaced in WSServerKey. Reports ns per key message parse, with
+// its topics, and per 200 and 400 response build. The 200 response is
+// also sent as one shared message, as WSServerKey does now.
+#include "WSJson.h"
+#include "WSMessage.h"
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <string>
+
+namespace {
+	const size_t iterations = 200000;
+
+	const std::string key_message =
+		"{\"key\":\"9f86d081884c7d659a2feaa0c55ad015\",\"topics\":[\"shop/12\",\"terminal/3\"]}";
+	const std::string expected_key = "9f86d081884c7d659a2feaa0c55ad015";
+
+	// Keeps the optimizer from dropping the work
+	volatile size_t sink = 0;
+
+	size_t ptree_parse() {
+		std::stringstream ss(key_message);
+		boost::property_tree::ptree tree;
+		boost::property_tree::json_parser::read_json(ss, tree);
+		size_t count = tree.get<std::string>("key") == expected_key ? 1 : 0;
+		if (auto topics = tree.get_child_optional("topics")) {
+			for (const auto& topic : *topics) {
+				count += topic.second.get_value<std::string>().size();
+			}
+		}
+		return count;
+	}
+
+	size_t json_parse() {
+		auto tree = websocket::json::parse(key_message);
+		size_t count = tree["key"].equals(expected_key) ? 1 : 0;
+		tree["topics"].for_each([&](const websocket::json::value& topic) {
+			std::string_view name;
+			if (topic.get(name)) {
+				count += name.size();
+			}
+		});
+		return count;
+	}
+
+	size_t ptree_response(bool is_error) {
+		boost::property_tree::ptree tree;
+		tree.add("status_code", is_error ? "400" : "200");
+		tree.add("message", is_error ? "Bad Request" : "OK");
+		if (is_error) {
+			tree.add("error", "Field rm_detail missing");
+		}
+		std::stringstream ss;
+		boost::property_tree::json_parser::write_json(ss, tree);
+		return ss.str().size();
+	}
+
+	size_t json_response(bool is_error) {
+		std::string response;
+		websocket::json::writer writer(response);
+		writer.begin_object();
+		writer.key("status_code").string(is_error ? "400" : "200");
+		writer.key("message").string(is_error ? "Bad Request" : "OK");
+		if (is_error) {
+			writer.key("error").string("Field rm_detail missing");
+		}
+		writer.end_object();
+		return response.size();
+	}
+
+	// The shared body is only referenced per session
+	size_t shared_response() {
+		static const websocket::SharedMessage ok = websocket::make_shared_message(
+			std::string("{\"status_code\":\"200\",\"message\":\"OK\"}"));
+		websocket::SharedMessage response = ok;
+		return response->size();
+	}
+
+	template<typename F>
+	double nanoseconds_per_call(F&& f) {
+		auto begin = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < iterations; ++i) {
+			sink += f();
+		}
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / iterations;
+	}
+}
+
+int main() {
+	printf("%-16s %14s %14s %8s\n", "case", "ptree ns", "WSJson ns", "speedup");
+
+	double before = nanoseconds_per_call(ptree_parse);
+	double after = nanoseconds_per_call(json_parse);
+	printf("%-16s %14.1f %14.1f %7.1fx\n", "parse key", before, after, before / after);
+
+	before = nanoseconds_per_call([]() { return ptree_response(false); });
+	after = nanoseconds_per_call([]() { return json_response(false); });
+	printf("%-16s %14.1f %14.1f %7.1fx\n", "response 200", before, after, before / after);
+
+	after = nanoseconds_per_call(shared_response);
+	printf("%-16s %14.1f %14.1f %7.1fx\n", "shared 200", before, after, before / after);
+
+	before = nanoseconds_per_call([]() { return ptree_response(true); });
+	after = nanoseconds_per_call([]() { return json_response(true); });
+	printf("%-16s %14.1f %14.1f %7.1fx\n", "response 400", before, after, before / after);
+
+	return 0;
+}
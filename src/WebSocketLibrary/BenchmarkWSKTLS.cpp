@@ -0,0 +1,150 @@
+// Benchmark of kernel TLS against OpenSSL records. Echoes 1 MB messages
+// over loopback with TLS 1.2 and 1.3 (AES-128-GCM), with and without
+// set_ktls, and reports MB/s both ways and how the sessions ran. Where the
+// kernel has no tls module the kTLS rows count fallbacks and match OpenSSL.
+#include "WSListener.h"
+
+#include <openssl/x509.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+// TLS 1.3 and the protocol bounds need OpenSSL 1.1.1
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+namespace {
+	using SSLListener = websocket::Listener<websocket::server_ssl_session, websocket::ssl_session>;
+	namespace ssl = boost::asio::ssl;
+	namespace ws = boost::beast::websocket;
+
+	const size_t message_size = 1024 * 1024;
+	const size_t round_trips = 256;
+
+	void on_echo(boost::beast::error_code ec, std::size_t, std::string&& data, std::shared_ptr<websocket::ssl_session> session) {
+		if (ec) {
+			return;
+		}
+		session->send(std::move(data));
+		session->receive(on_echo);
+	}
+
+	// Self signed P-256 certificate, so the benchmark needs no files
+	bool use_test_certificate(ssl::context& context) {
+		EVP_PKEY* key = nullptr;
+		EVP_PKEY_CTX* key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+		bool ok = key_ctx &&
+			EVP_PKEY_keygen_init(key_ctx) > 0 &&
+			EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_ctx, NID_X9_62_prime256v1) > 0 &&
+			EVP_PKEY_keygen(key_ctx, &key) > 0;
+		EVP_PKEY_CTX_free(key_ctx);
+
+		X509* certificate = ok ? X509_new() : nullptr;
+		if (certificate) {
+			ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+			X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+			X509_gmtime_adj(X509_getm_notAfter(certificate), 3600);
+			X509_set_pubkey(certificate, key);
+			X509_NAME* name = X509_get_subject_name(certificate);
+			X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+			X509_set_issuer_name(certificate, name);
+			ok = X509_sign(certificate, key, EVP_sha256()) > 0 &&
+				SSL_CTX_use_certificate(context.native_handle(), certificate) == 1 &&
+				SSL_CTX_use_PrivateKey(context.native_handle(), key) == 1;
+		}
+		X509_free(certificate);
+		EVP_PKEY_free(key);
+		return ok;
+	}
+
+	struct result {
+		double megabytes_per_second;
+		uint64_t ktls_send;
+		uint64_t ktls_receive;
+		uint64_t ktls_fallback;
+	};
+
+	bool run(const boost::asio::ip::tcp::endpoint& endpoint, int version, bool ktls, result& out) {
+		auto context = std::make_shared<ssl::context>(ssl::context::tls_server);
+		if (!use_test_certificate(*context)) {
+			return false;
+		}
+		SSL_CTX_set_min_proto_version(context->native_handle(), version);
+		SSL_CTX_set_max_proto_version(context->native_handle(), version);
+		SSL_CTX_set_ciphersuites(context->native_handle(), "TLS_AES_128_GCM_SHA256");
+		SSL_CTX_set_cipher_list(context->native_handle(), "ECDHE-ECDSA-AES128-GCM-SHA256");
+
+		boost::asio::io_context ioc(1);
+		auto listener = std::make_shared<SSLListener>(ioc, endpoint);
+		listener->set_ktls(ktls);
+		listener->set_ssl_context(context);
+		listener->set_idle_timeout(std::chrono::milliseconds(0));
+		listener->set_handshake_completed_handler([](std::shared_ptr<websocket::ssl_session> session) {
+			session->receive(on_echo);
+		});
+		if (!listener->run()) {
+			return false;
+		}
+		std::thread server([&ioc]() { ioc.run(); });
+
+		boost::asio::io_context client_ioc;
+		ssl::context client_context(ssl::context::tls_client);
+		ws::stream<ssl::stream<boost::asio::ip::tcp::socket>> stream(client_ioc, client_context);
+		stream.read_message_max(2 * message_size);
+		stream.next_layer().next_layer().connect(endpoint);
+		stream.next_layer().handshake(ssl::stream_base::client);
+		stream.handshake("127.0.0.1", "/");
+		stream.binary(true);
+
+		const std::string payload(message_size, 'x');
+		boost::beast::flat_buffer buffer;
+		auto begin = std::chrono::steady_clock::now();
+		for (size_t n = 0; n < round_trips; ++n) {
+			stream.write(boost::asio::buffer(payload));
+			stream.read(buffer);
+			buffer.consume(buffer.size());
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		stream.close(ws::close_code::normal);
+
+		auto metrics = listener->get_handshake_metrics();
+		out.megabytes_per_second = 2.0 * round_trips * message_size / (1024 * 1024) / seconds;
+		out.ktls_send = metrics->ktls_send.value();
+		out.ktls_receive = metrics->ktls_receive.value();
+		out.ktls_fallback = metrics->ktls_fallback.value();
+
+		listener->stop();
+		ioc.stop();
+		server.join();
+		return true;
+	}
+}
+
+int main() {
+	websocket::set_log_level(websocket::log_level::error);
+
+	unsigned short port = 18700;
+	printf("%-8s %-8s %10s %6s %8s %9s\n", "version", "records", "MB/s", "send", "receive", "fallback");
+	for (int version : { TLS1_2_VERSION, TLS1_3_VERSION }) {
+		for (bool ktls : { false, true }) {
+			boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::make_address("127.0.0.1"), port++);
+			const char* version_name = version == TLS1_2_VERSION ? "TLS1.2" : "TLS1.3";
+
+			result r;
+			if (!run(endpoint, version, ktls, r)) {
+				printf("%-8s %-8s failed to start\n", version_name, ktls ? "ktls" : "openssl");
+				continue;
+			}
+			printf("%-8s %-8s %10.1f %6llu %8llu %9llu\n", version_name, ktls ? "ktls" : "openssl", r.megabytes_per_second,
+				static_cast<unsigned long long>(r.ktls_send), static_cast<unsigned long long>(r.ktls_receive),
+				static_cast<unsigned long long>(r.ktls_fallback));
+		}
+	}
+	return 0;
+}
+#else
+int main() {
+	printf("kTLS benchmark needs OpenSSL 1.1.1 or later\n");
+	return 0;
+}
+#endif
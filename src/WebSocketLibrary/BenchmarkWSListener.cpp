@@ -0,0 +1,177 @@
+// Benchmark of the shared io_context model against thread per core.
+// "shared" runs one io_context and listener on every thread with a strand
+// per session, "per-core" one single threaded io_context and listener per
+// thread bound with SO_REUSEPORT, or fed round robin by one acceptor where
+// SO_REUSEPORT is not available. Reports connections/s (connect, handshake
+// and close) and echo round trips/s of 4 blocking client threads.
+#include "WSListener.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	using TCPListener = websocket::Listener<websocket::server_tcp_session, websocket::tcp_session>;
+	namespace ws = boost::beast::websocket;
+
+	const size_t client_threads = 4;
+	const size_t connections_per_client = 200;
+	const size_t sockets_per_client = 4;
+	const size_t messages_per_client = 4000;
+
+	void on_echo(boost::beast::error_code ec, std::size_t, std::string&& data, std::shared_ptr<websocket::tcp_session> session) {
+		if (ec) {
+			return;
+		}
+		session->send(std::move(data));
+		session->receive(on_echo);
+	}
+
+	class echo_server {
+		std::vector<std::unique_ptr<boost::asio::io_context>> contexts_;
+		std::vector<std::shared_ptr<TCPListener>> listeners_;
+		websocket::ThreadGroup threads_;
+	public:
+		bool start(const boost::asio::ip::tcp::endpoint& endpoint, size_t thread_count, bool per_core) {
+			size_t context_count = per_core ? thread_count : 1;
+			for (size_t i = 0; i < context_count; ++i) {
+				contexts_.emplace_back(std::make_unique<boost::asio::io_context>(per_core ? 1 : static_cast<int>(thread_count)));
+			}
+
+			if (!per_core) {
+				listeners_.emplace_back(make_listener(*contexts_.front(), endpoint));
+			}
+			else if (TCPListener::is_reuse_port_supported()) {
+				for (auto& ioc : contexts_) {
+					auto listener = make_listener(*ioc, endpoint);
+					listener->set_reuse_port(true);
+					listener->set_use_strand(false);
+					listeners_.emplace_back(std::move(listener));
+				}
+			}
+			else {
+				auto listener = make_listener(*contexts_.front(), endpoint);
+				listener->set_use_strand(false);
+				for (auto& ioc : contexts_) {
+					listener->add_worker_context(*ioc);
+				}
+				listeners_.emplace_back(std::move(listener));
+			}
+
+			for (auto& listener : listeners_) {
+				if (!listener->run()) {
+					return false;
+				}
+			}
+			for (auto& ioc : contexts_) {
+				auto context = ioc.get();
+				threads_.create_thread_count([context]() { context->run(); }, per_core ? 1 : thread_count);
+			}
+			return true;
+		}
+
+		void stop() {
+			for (auto& listener : listeners_) {
+				listener->stop();
+			}
+			for (auto& ioc : contexts_) {
+				ioc->stop();
+			}
+			threads_.join_and_clear_all();
+			listeners_.clear();
+			contexts_.clear();
+		}
+
+	private:
+		static std::shared_ptr<TCPListener> make_listener(boost::asio::io_context& ioc, const boost::asio::ip::tcp::endpoint& endpoint) {
+			auto listener = std::make_shared<TCPListener>(ioc, endpoint);
+			listener->set_idle_timeout(std::chrono::milliseconds(0));
+			listener->set_handshake_completed_handler([](std::shared_ptr<websocket::tcp_session> session) {
+				session->receive(on_echo);
+			});
+			return listener;
+		}
+	};
+
+	template<typename Work>
+	double run_clients(Work work) {
+		std::vector<std::thread> clients;
+		auto begin = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < client_threads; ++i) {
+			clients.emplace_back(work);
+		}
+		for (auto& t : clients) {
+			t.join();
+		}
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	}
+
+	double connections_per_second(const boost::asio::ip::tcp::endpoint& endpoint) {
+		double seconds = run_clients([&]() {
+			boost::asio::io_context ioc;
+			for (size_t n = 0; n < connections_per_client; ++n) {
+				ws::stream<boost::asio::ip::tcp::socket> stream(ioc);
+				stream.next_layer().connect(endpoint);
+				stream.handshake("127.0.0.1", "/");
+				stream.close(ws::close_code::normal);
+			}
+		});
+		return client_threads * connections_per_client / seconds;
+	}
+
+	double messages_per_second(const boost::asio::ip::tcp::endpoint& endpoint) {
+		const std::string payload(64, 'x');
+		double seconds = run_clients([&]() {
+			boost::asio::io_context ioc;
+			std::vector<std::unique_ptr<ws::stream<boost::asio::ip::tcp::socket>>> streams;
+			for (size_t i = 0; i < sockets_per_client; ++i) {
+				streams.emplace_back(std::make_unique<ws::stream<boost::asio::ip::tcp::socket>>(ioc));
+				streams.back()->next_layer().connect(endpoint);
+				streams.back()->handshake("127.0.0.1", "/");
+			}
+
+			boost::beast::flat_buffer buffer;
+			for (size_t n = 0; n < messages_per_client; ++n) {
+				auto& stream = *streams[n % streams.size()];
+				stream.write(boost::asio::buffer(payload));
+				stream.read(buffer);
+				buffer.consume(buffer.size());
+			}
+
+			for (auto& stream : streams) {
+				stream->close(ws::close_code::normal);
+			}
+		});
+		return client_threads * messages_per_client / seconds;
+	}
+}
+
+int main() {
+	websocket::set_log_level(websocket::log_level::error);
+
+	const size_t thread_counts[] = { 1, 2, 4, 8, 16 };
+	unsigned short port = 18100;
+
+	printf("%-8s %-10s %14s %14s\n", "threads", "model", "connections/s", "messages/s");
+	for (size_t threads : thread_counts) {
+		for (bool per_core : { false, true }) {
+			boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::make_address("127.0.0.1"), port++);
+
+			echo_server server;
+			if (!server.start(endpoint, threads, per_core)) {
+				printf("%-8zu %-10s failed to start\n", threads, per_core ? "per-core" : "shared");
+				continue;
+			}
+
+			double connections = connections_per_second(endpoint);
+			double messages = messages_per_second(endpoint);
+			server.stop();
+
+			printf("%-8zu %-10s %14.0f %14.0f\n", threads, per_core ? "per-core" : "shared", connections, messages);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,74 @@
+// Benchmark of the cost of one log call on the calling (io) thread.
+// "sync" is the former path which formatted, printed and then opened,
+// appended and closed the log file on every call, "async" is log().
+// Redirect stdout to a file or NUL, both variants print every line.
+#include "WSUtility.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	const size_t calls_per_thread = 20000;
+
+	void sync_log(const std::string& content) {
+		std::stringstream ss;
+		ss << websocket::get_now() << content << std::endl;
+
+		std::cout << ss.str();
+
+		std::ofstream ofs;
+		ofs.open(websocket::GetLogFilePath(), std::ios::binary | std::ios::app);
+		if (ofs && ofs.is_open()) {
+			ofs.write(ss.str().c_str(), ss.str().size());
+		}
+		ofs.close();
+	}
+
+	template<typename Log>
+	double run(size_t thread_count, Log log_line) {
+		const std::string line = "{\"sell_shopid\":\"0001\",\"sell_posid\":\"01\",\"sell_no\":\"000123\"}";
+
+		std::vector<std::thread> threads;
+		auto begin = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < thread_count; ++i) {
+			threads.emplace_back([&]() {
+				for (size_t n = 0; n < calls_per_thread; ++n) {
+					log_line(line);
+				}
+			});
+		}
+		for (auto& t : threads) {
+			t.join();
+		}
+		auto elapsed = std::chrono::steady_clock::now() - begin;
+
+		// Time spent per call from the point of view of one calling thread
+		return std::chrono::duration<double, std::nano>(elapsed).count() / calls_per_thread;
+	}
+}
+
+int main() {
+	const size_t thread_counts[] = { 1, 4 };
+
+	std::vector<std::string> results;
+	for (size_t threads : thread_counts) {
+		double sync_ns = run(threads, sync_log);
+		double async_ns = run(threads, [](const std::string& line) { websocket::log(line); });
+		websocket::AsyncLogger::instance().flush(std::chrono::seconds(30));
+
+		char result[128];
+		snprintf(result, sizeof(result), "%-8zu %14.0f %14.0f", threads, sync_ns, async_ns);
+		results.emplace_back(result);
+	}
+
+	fprintf(stderr, "%-8s %14s %14s\n", "threads", "sync ns/call", "async ns/call");
+	for (const auto& result : results) {
+		fprintf(stderr, "%s\n", result.c_str());
+	}
+	fprintf(stderr, "dropped lines: %llu\n",
+		static_cast<unsigned long long>(websocket::AsyncLogger::instance().dropped()));
+	return 0;
+}
@@ -0,0 +1,89 @@
+// Microbenchmark of the session write queue.
+// Compares LockQueue against MPSCQueue with 1, 4 and 16 producer threads
+// pushing into a single consumer, the access pattern of session_base.
+#include "WSUtility.h"
+#include "WSQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	const size_t total_messages = 1 << 21;
+	const std::string payload(64, 'x');
+
+	template<typename Queue, typename Consume>
+	double run(Queue& queue, size_t producer_count, Consume consume) {
+		const size_t per_producer = total_messages / producer_count;
+		const size_t expected = per_producer * producer_count;
+
+		std::atomic<bool> start(false);
+		std::vector<std::thread> producers;
+		for (size_t i = 0; i < producer_count; ++i) {
+			producers.emplace_back([&]() {
+				while (!start.load()) {}
+				for (size_t n = 0; n < per_producer; ++n) {
+					queue.push(std::string(payload));
+				}
+			});
+		}
+
+		auto begin = std::chrono::steady_clock::now();
+		start = true;
+
+		size_t consumed = 0;
+		while (consumed < expected) {
+			consumed += consume(queue);
+		}
+
+		auto elapsed = std::chrono::steady_clock::now() - begin;
+		for (auto& t : producers) {
+			t.join();
+		}
+		return std::chrono::duration<double>(elapsed).count();
+	}
+
+	size_t consume_lock_queue(websocket::LockQueue<std::string>& queue) {
+		// Same calls the session write path used to make per message
+		size_t count = 0;
+		while (!queue.empty()) {
+			std::string& front = queue.peek();
+			(void)front;
+			queue.consume_one();
+			++count;
+		}
+		return count;
+	}
+
+	size_t consume_mpsc_queue(websocket::MPSCQueue<std::string, 16>& queue) {
+		size_t count = 0;
+		while (std::string* front = queue.front()) {
+			(void)front;
+			queue.pop();
+			++count;
+		}
+		return count;
+	}
+}
+
+int main() {
+	const size_t producer_counts[] = { 1, 4, 16 };
+
+	printf("%-10s %-12s %12s %14s\n", "producers", "queue", "seconds", "messages/s");
+	for (size_t producers : producer_counts) {
+		{
+			websocket::LockQueue<std::string> queue;
+			double seconds = run(queue, producers, consume_lock_queue);
+			printf("%-10zu %-12s %12.3f %14.0f\n", producers, "LockQueue", seconds, total_messages / seconds);
+		}
+		{
+			websocket::MPSCQueue<std::string, 16> queue;
+			double seconds = run(queue, producers, consume_mpsc_queue);
+			printf("%-10zu %-12s %12.3f %14.0f\n", producers, "MPSCQueue", seconds, total_messages / seconds);
+		}
+	}
+	return 0;
+}
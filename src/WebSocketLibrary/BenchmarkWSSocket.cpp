@@ -0,0 +1,104 @@
+// Loopback round trip latency of small requests with the default socket
+// options against Nagle and delayed acks left on. Each request is written
+// as two messages and answered after the second one, the pattern where
+// the second small segment waits for the delayed ack of the first.
+#include "WSListener.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+	using TCPListener = websocket::Listener<websocket::server_tcp_session, websocket::tcp_session>;
+	namespace ws = boost::beast::websocket;
+
+	const size_t round_trips = 2000;
+
+	// Answer the last part of every request
+	void on_request(boost::beast::error_code ec, std::size_t, std::string&& data, std::shared_ptr<websocket::tcp_session> session) {
+		if (ec) {
+			return;
+		}
+		if (!data.empty() && data.back() == '!') {
+			session->send(std::move(data));
+		}
+		session->receive(on_request);
+	}
+
+	struct result {
+		double p50_us;
+		double p99_us;
+		double max_us;
+	};
+
+	result measure(const boost::asio::ip::tcp::endpoint& endpoint, const websocket::socket_options& options) {
+		boost::asio::io_context ioc;
+		ws::stream<boost::asio::ip::tcp::socket> stream(ioc);
+		stream.next_layer().connect(endpoint);
+		boost::system::error_code ec;
+		websocket::set_connection_options(stream.next_layer(), options, ec);
+		stream.handshake("127.0.0.1", "/");
+
+		const std::string header(16, 'h');
+		const std::string body = std::string(32, 'b') + "!";
+		boost::beast::flat_buffer buffer;
+		std::vector<double> samples;
+		samples.reserve(round_trips);
+		for (size_t n = 0; n < round_trips; ++n) {
+			auto begin = std::chrono::steady_clock::now();
+			stream.write(boost::asio::buffer(header));
+			stream.write(boost::asio::buffer(body));
+			stream.read(buffer);
+			buffer.consume(buffer.size());
+			samples.emplace_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+		}
+		stream.close(ws::close_code::normal);
+
+		std::sort(samples.begin(), samples.end());
+		return { samples[samples.size() / 2], samples[samples.size() * 99 / 100], samples.back() };
+	}
+}
+
+int main() {
+	websocket::set_log_level(websocket::log_level::error);
+
+	websocket::socket_options tuned;
+	websocket::socket_options untuned;
+	untuned.no_delay = false;
+	untuned.quick_ack = false;
+
+	const std::pair<const char*, websocket::socket_options> cases[] = {
+		{ "default", tuned },
+		{ "nagle", untuned },
+	};
+
+	unsigned short port = 18300;
+	printf("%-10s %12s %12s %12s\n", "options", "p50 us", "p99 us", "max us");
+	for (auto& c : cases) {
+		boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::make_address("127.0.0.1"), port++);
+
+		boost::asio::io_context ioc(1);
+		auto listener = std::make_shared<TCPListener>(ioc, endpoint);
+		listener->set_socket_options(c.second);
+		listener->set_idle_timeout(std::chrono::milliseconds(0));
+		listener->set_handshake_completed_handler([](std::shared_ptr<websocket::tcp_session> session) {
+			session->receive(on_request);
+		});
+		if (!listener->run()) {
+			printf("%-10s failed to listen\n", c.first);
+			continue;
+		}
+		std::thread server([&ioc]() { ioc.run(); });
+
+		result r = measure(endpoint, c.second);
+
+		listener->stop();
+		ioc.stop();
+		server.join();
+
+		printf("%-10s %12.1f %12.1f %12.1f\n", c.first, r.p50_us, r.p99_us, r.max_us);
+	}
+	return 0;
+}
@@ -0,0 +1,313 @@
+// Test of kernel TLS. Checks that ktls::derive gives the keys of the
+// records OpenSSL writes, by opening them with AES-GCM, for TLS 1.2 and 1.3
+// and both key sizes. Then echoes messages across record boundaries through
+// a listener with set_ktls and checks them byte for byte. Where the kernel
+// has no tls module the sessions fall back to OpenSSL records, the echo
+// still has to pass and the output says which path ran.
+#include "WSListener.h"
+
+#include <openssl/x509.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+// TLS 1.3 and the protocol bounds need OpenSSL 1.1.1
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+namespace {
+	using SSLListener = websocket::Listener<websocket::server_ssl_session, websocket::ssl_session>;
+	namespace ssl = boost::asio::ssl;
+	namespace ws = boost::beast::websocket;
+
+	// Self signed P-256 certificate, so the test needs no files
+	bool use_test_certificate(ssl::context& context) {
+		EVP_PKEY* key = nullptr;
+		EVP_PKEY_CTX* key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+		bool ok = key_ctx &&
+			EVP_PKEY_keygen_init(key_ctx) > 0 &&
+			EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_ctx, NID_X9_62_prime256v1) > 0 &&
+			EVP_PKEY_keygen(key_ctx, &key) > 0;
+		EVP_PKEY_CTX_free(key_ctx);
+
+		X509* certificate = ok ? X509_new() : nullptr;
+		if (certificate) {
+			ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+			X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+			X509_gmtime_adj(X509_getm_notAfter(certificate), 3600);
+			X509_set_pubkey(certificate, key);
+			X509_NAME* name = X509_get_subject_name(certificate);
+			X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+			X509_set_issuer_name(certificate, name);
+			ok = X509_sign(certificate, key, EVP_sha256()) > 0 &&
+				SSL_CTX_use_certificate(context.native_handle(), certificate) == 1 &&
+				SSL_CTX_use_PrivateKey(context.native_handle(), key) == 1;
+		}
+		X509_free(certificate);
+		EVP_PKEY_free(key);
+		return ok;
+	}
+
+	void set_version(ssl::context& context, int version, const char* cipher) {
+		SSL_CTX_set_min_proto_version(context.native_handle(), version);
+		SSL_CTX_set_max_proto_version(context.native_handle(), version);
+		if (version == TLS1_3_VERSION) {
+			SSL_CTX_set_ciphersuites(context.native_handle(), cipher);
+		}
+		else {
+			SSL_CTX_set_cipher_list(context.native_handle(), cipher);
+		}
+	}
+
+#if defined(WS_HAS_KTLS)
+	using websocket::ktls::traffic_keys;
+
+	std::string drain(BIO* bio) {
+		std::string data;
+		char buffer[16 * 1024];
+		int n;
+		while ((n = BIO_read(bio, buffer, sizeof(buffer))) > 0) {
+			data.append(buffer, n);
+		}
+		return data;
+	}
+
+	// Moves the bytes of one end to the other until both are quiet
+	void pump(SSL* client, SSL* server) {
+		for (int i = 0; i < 16; ++i) {
+			std::string to_server = drain(SSL_get_wbio(client));
+			BIO_write(SSL_get_rbio(server), to_server.data(), static_cast<int>(to_server.size()));
+			std::string to_client = drain(SSL_get_wbio(server));
+			BIO_write(SSL_get_rbio(client), to_client.data(), static_cast<int>(to_client.size()));
+			SSL_do_handshake(client);
+			SSL_do_handshake(server);
+		}
+	}
+
+	// Decrypts the application data record in record with keys
+	bool open_record(const std::string& record, const traffic_keys& keys, std::string& plain) {
+		const size_t header = 5;
+		const size_t tag = 16;
+		if (record.size() < header) {
+			return false;
+		}
+		size_t length = (static_cast<unsigned char>(record[3]) << 8) | static_cast<unsigned char>(record[4]);
+		if (record.size() != header + length) {
+			return false;
+		}
+
+		const unsigned char* body = reinterpret_cast<const unsigned char*>(record.data()) + header;
+		unsigned char nonce[12];
+		std::memcpy(nonce, keys.salt, sizeof(keys.salt));
+		std::string aad;
+		const unsigned char* cipher_text;
+		size_t cipher_length;
+		if (keys.version == TLS1_3_VERSION) {
+			if (length < tag) {
+				return false;
+			}
+			std::memcpy(nonce + 4, keys.iv, sizeof(keys.iv));
+			for (int i = 0; i < 8; ++i) {
+				nonce[4 + i] ^= keys.sequence[i];
+			}
+			aad = record.substr(0, header);
+			cipher_text = body;
+			cipher_length = length - tag;
+		}
+		else {
+			if (length < 8 + tag) {
+				return false;
+			}
+			std::memcpy(nonce + 4, body, 8);
+			cipher_text = body + 8;
+			cipher_length = length - 8 - tag;
+			aad.assign(reinterpret_cast<const char*>(keys.sequence), sizeof(keys.sequence));
+			aad.append(record, 0, 3);
+			aad.push_back(static_cast<char>(cipher_length >> 8));
+			aad.push_back(static_cast<char>(cipher_length));
+		}
+
+		EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+		int n = 0;
+		plain.resize(cipher_length);
+		bool ok = ctx &&
+			EVP_DecryptInit_ex(ctx, keys.key_length == 16 ? EVP_aes_128_gcm() : EVP_aes_256_gcm(), nullptr, keys.key, nonce) > 0 &&
+			EVP_DecryptUpdate(ctx, nullptr, &n, reinterpret_cast<const unsigned char*>(aad.data()), static_cast<int>(aad.size())) > 0 &&
+			EVP_DecryptUpdate(ctx, reinterpret_cast<unsigned char*>(&plain[0]), &n, cipher_text, static_cast<int>(cipher_length)) > 0 &&
+			EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, static_cast<int>(tag), const_cast<unsigned char*>(cipher_text + cipher_length)) > 0 &&
+			EVP_DecryptFinal_ex(ctx, reinterpret_cast<unsigned char*>(&plain[0]) + n, &n) > 0;
+		EVP_CIPHER_CTX_free(ctx);
+
+		// TLS 1.3 ends the plain text with the content type, then padding
+		if (ok && keys.version == TLS1_3_VERSION) {
+			while (!plain.empty() && plain.back() == 0) {
+				plain.pop_back();
+			}
+			ok = !plain.empty() && plain.back() == 23;
+			if (ok) {
+				plain.pop_back();
+			}
+		}
+		return ok;
+	}
+
+	// Handshake over memory BIOs, then the derived keys of the server have
+	// to open one record each way
+	bool check_derive(int version, const char* cipher) {
+		ssl::context server_context(ssl::context::tls_server);
+		ssl::context client_context(ssl::context::tls_client);
+		if (!use_test_certificate(server_context)) {
+			return false;
+		}
+		websocket::ktls::prepare(server_context);
+		set_version(server_context, version, cipher);
+		set_version(client_context, version, cipher);
+
+		SSL* server = SSL_new(server_context.native_handle());
+		SSL* client = SSL_new(client_context.native_handle());
+		SSL_set_bio(server, BIO_new(BIO_s_mem()), BIO_new(BIO_s_mem()));
+		SSL_set_bio(client, BIO_new(BIO_s_mem()), BIO_new(BIO_s_mem()));
+		SSL_set_accept_state(server);
+		SSL_set_connect_state(client);
+		pump(client, server);
+
+		// The client reads the TLS 1.3 session tickets
+		char scratch[16];
+		SSL_read(client, scratch, sizeof(scratch));
+
+		// Tickets took sequence numbers of the server, a key update restarts
+		// them, and checks that derive follows the update
+		int updates = 0;
+		uint64_t send_sequence = 1;
+		uint64_t receive_sequence = 1;
+		if (version == TLS1_3_VERSION) {
+			SSL_key_update(server, SSL_KEY_UPDATE_NOT_REQUESTED);
+			SSL_do_handshake(server);
+			std::string update = drain(SSL_get_wbio(server));
+			BIO_write(SSL_get_rbio(client), update.data(), static_cast<int>(update.size()));
+			SSL_read(client, scratch, sizeof(scratch));
+			updates = 1;
+			send_sequence = 0;
+			receive_sequence = 0;
+		}
+
+		traffic_keys send_keys;
+		traffic_keys receive_keys;
+		bool derived = websocket::ktls::derive(server, true, updates, send_sequence, send_keys) &&
+			websocket::ktls::derive(server, false, 0, receive_sequence, receive_keys);
+
+		SSL_write(server, "from server", 11);
+		std::string sent = drain(SSL_get_wbio(server));
+		SSL_write(client, "from client", 11);
+		std::string received = drain(SSL_get_wbio(client));
+
+		std::string sent_plain;
+		std::string received_plain;
+		bool ok = derived &&
+			open_record(sent, send_keys, sent_plain) && sent_plain == "from server" &&
+			open_record(received, receive_keys, received_plain) && received_plain == "from client";
+		printf("derive  %-8s %-30s %s\n", version == TLS1_3_VERSION ? "TLS1.3" : "TLS1.2", cipher, ok ? "ok" : "FAILED");
+
+		SSL_free(server);
+		SSL_free(client);
+		return ok;
+	}
+#endif
+
+	void on_echo(boost::beast::error_code ec, std::size_t, std::string&& data, std::shared_ptr<websocket::ssl_session> session) {
+		if (ec) {
+			return;
+		}
+		session->send_binary(std::move(data));
+		session->receive(on_echo);
+	}
+
+	// Echo through a listener with set_ktls, sizes around the 16 KB record
+	bool check_echo(const boost::asio::ip::tcp::endpoint& endpoint, int version, const char* cipher) {
+		auto context = std::make_shared<ssl::context>(ssl::context::tls_server);
+		if (!use_test_certificate(*context)) {
+			return false;
+		}
+		set_version(*context, version, cipher);
+
+		boost::asio::io_context ioc(1);
+		auto listener = std::make_shared<SSLListener>(ioc, endpoint);
+		listener->set_ktls(true);
+		listener->set_ssl_context(context);
+		listener->set_idle_timeout(std::chrono::milliseconds(0));
+		listener->set_handshake_completed_handler([](std::shared_ptr<websocket::ssl_session> session) {
+			session->receive(on_echo);
+		});
+		if (!listener->run()) {
+			return false;
+		}
+		std::thread server([&ioc]() { ioc.run(); });
+
+		bool ok = true;
+		try {
+			boost::asio::io_context client_ioc;
+			ssl::context client_context(ssl::context::tls_client);
+			ws::stream<ssl::stream<boost::asio::ip::tcp::socket>> stream(client_ioc, client_context);
+			stream.read_message_max(0);
+			stream.next_layer().next_layer().connect(endpoint);
+			stream.next_layer().handshake(ssl::stream_base::client);
+			stream.handshake("127.0.0.1", "/");
+			stream.binary(true);
+
+			for (size_t size : { 1, 16 * 1024 - 1, 16 * 1024 + 1, 1024 * 1024 }) {
+				std::string payload(size, '\0');
+				for (size_t i = 0; i < size; ++i) {
+					payload[i] = static_cast<char>(i * 31 + size);
+				}
+				boost::beast::flat_buffer buffer;
+				stream.write(boost::asio::buffer(payload));
+				stream.read(buffer);
+				ok = ok && boost::beast::buffers_to_string(buffer.data()) == payload;
+			}
+			stream.close(ws::close_code::normal);
+		}
+		catch (const std::exception& e) {
+			printf("echo    %s\n", e.what());
+			ok = false;
+		}
+
+		auto metrics = listener->get_handshake_metrics();
+		printf("echo    %-8s %-30s %s send=%llu receive=%llu fallback=%llu\n",
+			version == TLS1_3_VERSION ? "TLS1.3" : "TLS1.2", cipher, ok ? "ok" : "FAILED",
+			static_cast<unsigned long long>(metrics->ktls_send.value()),
+			static_cast<unsigned long long>(metrics->ktls_receive.value()),
+			static_cast<unsigned long long>(metrics->ktls_fallback.value()));
+
+		listener->stop();
+		ioc.stop();
+		server.join();
+		return ok;
+	}
+}
+
+int main() {
+	websocket::set_log_level(websocket::log_level::error);
+
+	bool ok = true;
+#if defined(WS_HAS_KTLS)
+	ok = check_derive(TLS1_3_VERSION, "TLS_AES_128_GCM_SHA256") && ok;
+	ok = check_derive(TLS1_3_VERSION, "TLS_AES_256_GCM_SHA384") && ok;
+	ok = check_derive(TLS1_2_VERSION, "ECDHE-ECDSA-AES128-GCM-SHA256") && ok;
+	ok = check_derive(TLS1_2_VERSION, "ECDHE-ECDSA-AES256-GCM-SHA384") && ok;
+#endif
+
+	unsigned short port = 18800;
+	ok = check_echo(boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), port++),
+		TLS1_3_VERSION, "TLS_AES_128_GCM_SHA256") && ok;
+	ok = check_echo(boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), port++),
+		TLS1_2_VERSION, "ECDHE-ECDSA-AES256-GCM-SHA384") && ok;
+
+	printf("kernel tls %s, %s\n", websocket::ktls::is_available() ? "available" : "not available", ok ? "passed" : "FAILED");
+	return ok ? 0 : 1;
+}
+#else
+int main() {
+	printf("kTLS test needs OpenSSL 1.1.1 or later\n");
+	return 0;
+}
+#endif
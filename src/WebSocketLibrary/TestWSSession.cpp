@@ -0,0 +1,150 @@
+// Test of write batching. Queues messages on a session whose transport
+// counts its writes and checks that a batch goes out as one write, that
+// without batching every message is its own write, and that a ping is
+// still answered once the batch was flushed.
+#include "WSSession.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+	namespace ws = boost::beast::websocket;
+	using tcp = boost::asio::ip::tcp;
+
+	// TCP stream that counts the writes reaching it
+	class counting_stream : public boost::beast::tcp_stream {
+	public:
+		std::size_t writes = 0;
+
+		using boost::beast::tcp_stream::tcp_stream;
+
+		template<typename ConstBufferSequence, typename WriteHandler>
+		auto async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler) {
+			++writes;
+			return boost::beast::tcp_stream::async_write_some(buffers, std::forward<WriteHandler>(handler));
+		}
+	};
+
+	template<typename TeardownHandler>
+	void async_teardown(boost::beast::role_type role, counting_stream& stream, TeardownHandler&& handler) {
+		boost::beast::async_teardown(role, static_cast<boost::beast::tcp_stream&>(stream), std::forward<TeardownHandler>(handler));
+	}
+
+	void teardown(boost::beast::role_type role, counting_stream& stream, boost::beast::error_code& ec) {
+		boost::beast::teardown(role, static_cast<boost::beast::tcp_stream&>(stream), ec);
+	}
+
+	using counted_session =websocket::session_base<websocket::metered_stream<websocket::batch_stream<counting_stream>>>;
+
+	class batch_session : public counted_session {
+	public:
+		batch_session(tcp::socket&& socket, boost::asio::io_context& ioc)
+			: counted_session(std::move(socket), ioc) {
+		}
+
+		void accept() {
+			ws_.async_accept([](boost::beast::error_code ec) {
+				if (ec) {
+					websocket::exception_log("session accept", ec);
+				}
+			});
+		}
+
+		std::size_t writes() {
+			return transport().writes;
+		}
+	};
+
+	bool check_batch(bool batching, std::size_t messages, std::size_t expected_writes) {
+		boost::asio::io_context ioc(1);
+		tcp::acceptor acceptor(ioc, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+		std::shared_ptr<batch_session> session;
+		acceptor.async_accept(boost::asio::make_strand(ioc),
+			[&](boost::beast::error_code ec, tcp::socket socket) {
+			if (!ec) {
+				session = std::make_shared<batch_session>(std::move(socket), ioc);
+				session->accept();
+			}
+		});
+
+		ws::stream<tcp::socket> client(ioc);
+		client.next_layer().async_connect(acceptor.local_endpoint(), [&](boost::beast::error_code ec) {
+			if (!ec) {
+				client.async_handshake("127.0.0.1", "/", [](boost::beast::error_code) {});
+			}
+		});
+		ioc.run();
+		ioc.restart();
+		if (!session || !client.is_open()) {
+			printf("batch   handshake FAILED\n");
+			return false;
+		}
+
+		// Queued before the strand runs, so they are drained as one batch
+		session->set_write_batching(batching);
+		std::size_t before = session->writes();
+		std::size_t completed = 0;
+		for (std::size_t i = 0; i < messages; ++i) {
+			session->send("message " + std::to_string(i),
+				[&completed](boost::beast::error_code ec, std::size_t, std::shared_ptr<counted_session>) {
+				if (!ec) {
+					++completed;
+				}
+			});
+		}
+
+		std::vector<std::string> received;
+		boost::beast::flat_buffer buffer;
+		std::function<void(boost::beast::error_code, std::size_t)> on_read =
+			[&](boost::beast::error_code ec, std::size_t) {
+			if (ec) {
+				return;
+			}
+			received.push_back(boost::beast::buffers_to_string(buffer.data()));
+			buffer.consume(buffer.size());
+			if (received.size() < messages) {
+				client.async_read(buffer, on_read);
+			}
+		};
+		client.async_read(buffer, on_read);
+		ioc.run();
+		ioc.restart();
+		std::size_t writes = session->writes() - before;
+
+		bool ok = writes == expected_writes && completed == messages &&
+			received.size() == messages && session->queued_bytes() == 0;
+		for (std::size_t i = 0; ok && i < messages; ++i) {
+			ok = received[i] == "message " + std::to_string(i);
+		}
+
+		// The pong goes through the batching layer as well
+		bool is_pong = false;
+		session->receive([](boost::beast::error_code, std::size_t, std::string&&, std::shared_ptr<counted_session>) {});
+		client.control_callback([&](ws::frame_type kind, boost::beast::string_view) {
+			if (kind == ws::frame_type::pong) {
+				is_pong = true;
+				client.next_layer().cancel();
+			}
+		});
+		client.async_ping({}, [](boost::beast::error_code) {});
+		client.async_read(buffer, [](boost::beast::error_code, std::size_t) {});
+		ioc.run_for(std::chrono::seconds(5));
+		ok = ok && is_pong;
+
+		printf("batch   %-8s %zu messages, %zu writes, %s\n",
+			batching ? "on" : "off", messages, writes, ok ? "ok" : "FAILED");
+		return ok;
+	}
+}
+
+int main() {
+	websocket::set_log_level(websocket::log_level::error);
+
+	bool ok = true;
+	ok = check_batch(true, 32, 1) && ok;
+	ok = check_batch(false, 32, 32) && ok;
+
+	printf("write batching %s\n", ok ? "passed" : "FAILED");
+	return ok ? 0 : 1;
+}
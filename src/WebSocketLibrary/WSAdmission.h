@@ -0,0 +1,195 @@
+#pragma once
+#include <boost/asio/ip/address.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "WSDefinition.h"
+
+namespace websocket {
+	// Admission control shared by the listeners of one server. Listeners
+	// ask accept_delay() before accepting and pause while it is not zero,
+	// and every admitted connection holds a ticket until its session ends.
+	class AdmissionControl : public std::enable_shared_from_this<AdmissionControl> {
+	public:
+		// Held by a session, releases its slots when destroyed
+		class ticket {
+			std::shared_ptr<AdmissionControl> control_;
+			boost::asio::ip::address address_;
+			std::atomic<bool> handshaking_;
+		public:
+			ticket(std::shared_ptr<AdmissionControl> control, const boost::asio::ip::address& address)
+				: control_(std::move(control))
+				, address_(address)
+				, handshaking_(true) {
+			}
+
+			~ticket() {
+				control_->release(address_, handshaking_.exchange(false));
+			}
+
+			void handshake_completed() {
+				if (handshaking_.exchange(false)) {
+					control_->release_handshake();
+				}
+			}
+		};
+
+		// Returned by accept_delay while a connection or handshake slot is needed
+		static constexpr std::chrono::milliseconds wait_for_release = (std::chrono::milliseconds::max)();
+
+	private:
+		std::mutex mutex_;
+		admission_limits limits_;
+		std::size_t connections_;
+		std::size_t pending_handshakes_;
+		std::map<boost::asio::ip::address, std::size_t> per_address_;
+
+		// Token bucket of the accept rate
+		double tokens_;
+		std::chrono::steady_clock::time_point refilled_;
+
+		// Paused listeners, resumed once a slot is released
+		std::vector<std::function<void()>> waiters_;
+
+		std::atomic<uint64_t> rejected_;
+
+	public:
+		explicit AdmissionControl(const admission_limits& limits)
+			: limits_(limits)
+			, connections_(0)
+			, pending_handshakes_(0)
+			, tokens_(static_cast<double>(burst(limits)))
+			, refilled_(std::chrono::steady_clock::now())
+			, rejected_(0)
+		{
+		}
+
+		// Zero to accept now, otherwise how long to pause
+		std::chrono::milliseconds accept_delay() {
+			std::lock_guard<std::mutex> guard(mutex_);
+			if (is_full()) {
+				return wait_for_release;
+			}
+			if (limits_.accept_rate > 0) {
+				refill();
+				if (tokens_ < 1) {
+					auto wait = std::chrono::duration<double>((1 - tokens_) / static_cast<double>(limits_.accept_rate));
+					return (std::max)(std::chrono::milliseconds(1),
+						std::chrono::duration_cast<std::chrono::milliseconds>(wait));
+				}
+			}
+			return std::chrono::milliseconds(0);
+		}
+
+		// Call resume once after the next release, return false if a slot
+		// is already available and the caller should try again now.
+		bool wait(std::function<void()>&& resume) {
+			std::lock_guard<std::mutex> guard(mutex_);
+			if (!is_full()) {
+				return false;
+			}
+			waiters_.emplace_back(std::move(resume));
+			return true;
+		}
+
+		// Take the slots of an accepted connection, nullptr if it must be
+		// closed. Limits may be exceeded by listeners racing to admit,
+		// those connections are rejected here.
+		std::shared_ptr<ticket> admit(const boost::asio::ip::address& address) {
+			{
+				std::lock_guard<std::mutex> guard(mutex_);
+				std::size_t& count = per_address_[address];
+				if (is_full() ||
+					(limits_.max_connections_per_ip != 0 && count >= limits_.max_connections_per_ip)) {
+					if (count == 0) {
+						per_address_.erase(address);
+					}
+					rejected_.fetch_add(1, std::memory_order_relaxed);
+					return nullptr;
+				}
+
+				++count;
+				++connections_;
+				++pending_handshakes_;
+				if (limits_.accept_rate > 0) {
+					refill();
+					tokens_ -= 1;
+				}
+			}
+			return std::make_shared<ticket>(shared_from_this(), address);
+		}
+
+		std::size_t connections() {
+			std::lock_guard<std::mutex> guard(mutex_);
+			return connections_;
+		}
+
+		std::size_t pending_handshakes() {
+			std::lock_guard<std::mutex> guard(mutex_);
+			return pending_handshakes_;
+		}
+
+		// Connections closed right after accept
+		uint64_t rejected() const {
+			return rejected_;
+		}
+
+	private:
+		static std::size_t burst(const admission_limits& limits) {
+			if (limits.accept_burst != 0) {
+				return limits.accept_burst;
+			}
+			return std::max<std::size_t>(1, limits.accept_rate);
+		}
+
+		bool is_full() const {
+			return (limits_.max_connections != 0 && connections_ >= limits_.max_connections) ||
+				(limits_.max_pending_handshakes != 0 && pending_handshakes_ >= limits_.max_pending_handshakes);
+		}
+
+		void refill() {
+			auto now = std::chrono::steady_clock::now();
+			double elapsed = std::chrono::duration<double>(now - refilled_).count();
+			refilled_ = now;
+			tokens_ = std::min<double>(static_cast<double>(burst(limits_)), tokens_ + elapsed * static_cast<double>(limits_.accept_rate));
+		}
+
+		void release(const boost::asio::ip::address& address, bool handshaking) {
+			std::vector<std::function<void()>> waiters;
+			{
+				std::lock_guard<std::mutex> guard(mutex_);
+				auto itor = per_address_.find(address);
+				if (itor != per_address_.end() && --itor->second == 0) {
+					per_address_.erase(itor);
+				}
+				--connections_;
+				if (handshaking) {
+					--pending_handshakes_;
+				}
+				waiters.swap(waiters_);
+			}
+			for (auto& resume : waiters) {
+				resume();
+			}
+		}
+
+		void release_handshake() {
+			std::vector<std::function<void()>> waiters;
+			{
+				std::lock_guard<std::mutex> guard(mutex_);
+				--pending_handshakes_;
+				waiters.swap(waiters_);
+			}
+			for (auto& resume : waiters) {
+				resume();
+			}
+		}
+	};
+}
@@ -0,0 +1,164 @@
+#pragma once
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket/teardown.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/write.hpp>
+
+#include <type_traits>
+#include <utility>
+
+namespace websocket {
+	// Stream below a websocket stream that gathers its writes. From cork()
+	// until async_flush() every frame the websocket stream writes, pings,
+	// pongs and close frames included, is copied into one buffer and
+	// completes at once, the flush then writes them with a single write.
+	// Uncorked it only forwards. Only touched on the session strand.
+	template<typename NextLayer>
+	class batch_stream {
+	public:
+		using next_layer_type = NextLayer;
+		using executor_type = typename NextLayer::executor_type;
+
+	private:
+		NextLayer next_;
+
+		// Frames gathered while corked, or while a flush is writing
+		boost::beast::flat_buffer gathered_;
+
+		// Frames the flush is writing
+		boost::beast::flat_buffer flushing_;
+
+		bool is_corked_;
+		bool is_flushing_;
+
+	public:
+		template<typename... Args>
+		explicit batch_stream(Args&&... args)
+			: next_(std::forward<Args>(args)...)
+			, is_corked_(false)
+			, is_flushing_(false) {
+		}
+
+		executor_type get_executor() noexcept {
+			return next_.get_executor();
+		}
+
+		next_layer_type& next_layer() noexcept {
+			return next_;
+		}
+
+		const next_layer_type& next_layer() const noexcept {
+			return next_;
+		}
+
+		void cork() {
+			is_corked_ = true;
+		}
+
+		bool is_corked() const {
+			return is_corked_;
+		}
+
+		// Stop gathering and drop what was gathered, the stream is broken
+		void discard() {
+			is_corked_ = false;
+			gathered_.clear();
+		}
+
+		// Stop gathering and write the gathered frames, handler(ec) runs
+		// once they and anything gathered meanwhile are written
+		template<typename FlushHandler>
+		void async_flush(FlushHandler&& handler) {
+			is_corked_ = false;
+			if (gathered_.size() == 0) {
+				boost::asio::post(next_.get_executor(), boost::beast::bind_front_handler(
+					std::forward<FlushHandler>(handler), boost::beast::error_code{}));
+				return;
+			}
+			is_flushing_ = true;
+			do_flush(typename std::decay<FlushHandler>::type(std::forward<FlushHandler>(handler)));
+		}
+
+		template<typename MutableBufferSequence>
+		std::size_t read_some(const MutableBufferSequence& buffers) {
+			return next_.read_some(buffers);
+		}
+
+		template<typename MutableBufferSequence>
+		std::size_t read_some(const MutableBufferSequence& buffers, boost::beast::error_code& ec) {
+			return next_.read_some(buffers, ec);
+		}
+
+		template<typename ConstBufferSequence>
+		std::size_t write_some(const ConstBufferSequence& buffers) {
+			boost::beast::error_code ec;
+			std::size_t bytes = write_some(buffers, ec);
+			if (ec) {
+				BOOST_THROW_EXCEPTION(boost::system::system_error{ ec });
+			}
+			return bytes;
+		}
+
+		// A synchronous close goes out after the frames gathered so far,
+		// a flush in progress already owns its frames
+		template<typename ConstBufferSequence>
+		std::size_t write_some(const ConstBufferSequence& buffers, boost::beast::error_code& ec) {
+			if (!is_flushing_ && gathered_.size() != 0) {
+				boost::asio::write(next_, gathered_.data(), ec);
+				gathered_.clear();
+				if (ec) {
+					return 0;
+				}
+			}
+			return next_.write_some(buffers, ec);
+		}
+
+		template<typename MutableBufferSequence, typename ReadHandler>
+		auto async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler) {
+			return next_.async_read_some(buffers, std::forward<ReadHandler>(handler));
+		}
+
+		template<typename ConstBufferSequence, typename WriteHandler>
+		void async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler) {
+			if (!is_corked_ && !is_flushing_) {
+				next_.async_write_some(buffers, std::forward<WriteHandler>(handler));
+				return;
+			}
+			std::size_t bytes = boost::asio::buffer_size(buffers);
+			gathered_.commit(boost::asio::buffer_copy(gathered_.prepare(bytes), buffers));
+			boost::asio::post(next_.get_executor(), boost::beast::bind_front_handler(
+				std::forward<WriteHandler>(handler), boost::beast::error_code{}, bytes));
+		}
+
+	private:
+		template<typename FlushHandler>
+		void do_flush(FlushHandler&& handler) {
+			std::swap(gathered_, flushing_);
+			boost::asio::async_write(next_, flushing_.data(),
+				[this, handler = std::move(handler)]
+			(boost::beast::error_code ec, std::size_t) mutable {
+				flushing_.clear();
+				if (!ec && gathered_.size() != 0) {
+					return do_flush(std::move(handler));
+				}
+				is_flushing_ = false;
+				if (ec) {
+					gathered_.clear();
+				}
+				handler(ec);
+			});
+		}
+	};
+
+	template<typename NextLayer, typename TeardownHandler>
+	void async_teardown(boost::beast::role_type role, batch_stream<NextLayer>& stream, TeardownHandler&& handler) {
+		using boost::beast::websocket::async_teardown;
+		async_teardown(role, stream.next_layer(), std::forward<TeardownHandler>(handler));
+	}
+
+	template<typename NextLayer>
+	void teardown(boost::beast::role_type role, batch_stream<NextLayer>& stream, boost::beast::error_code& ec) {
+		using boost::beast::websocket::teardown;
+		teardown(role, stream.next_layer(), ec);
+	}
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "WSSession.h"
+#include "WSSocket.h"
 #include <boost/lexical_cast.hpp>
 
 namespace websocket {
@@ -9,6 +10,11 @@ namespace websocket {
 		std::string port_;
 
 		OnConnectionCompleted<tcp_session> connected_handler_;
+
+		socket_options socket_options_;
+
+		// Tells whether the server accepted permessage-deflate
+		boost::beast::websocket::response_type handshake_response_;
 	public: 
 		explicit client_tcp_session(
 			boost::asio::io_context& ioc,
@@ -19,7 +25,15 @@ namespace websocket {
 			, host_(host)
 			, port_(port)
 		{
+			// Liveness needs an outstanding read which a client may not keep,
+			// so only ping and never time out unless asked to
+			idle_timeout_ = std::chrono::milliseconds(0);
+			ping_interval_ = default_ping_interval;
+		}
 
+		// TCP tuning of the connection, set before run
+		void set_socket_options(const socket_options& options) {
+			socket_options_ = options;
 		}
 
 		void run(const OnConnectionCompleted<tcp_session>& handler) {
@@ -55,6 +69,17 @@ namespace websocket {
 			if (ec)
 				return exception_log("connect", ec);
 
+			// The connect reopens the socket for every endpoint it tries,
+			// so the options are only set once one of them succeeded.
+			auto& socket = boost::beast::get_lowest_layer(ws_).socket();
+			set_buffer_sizes(socket, socket_options_, ec);
+			if (!ec) {
+				set_connection_options(socket, socket_options_, ec);
+			}
+			if (ec) {
+				exception_log("set_option", ec);
+			}
+
 			// Turn off the timeout on the tcp_stream, because
 			// the websocket stream has its own timeout system.
 			boost::beast::get_lowest_layer(ws_).expires_never();
@@ -74,7 +99,8 @@ namespace websocket {
 			}));
 
 			// Perform the websocket handshake
-			ws_.async_handshake(host_, "/",
+			offer_compression();
+			ws_.async_handshake(handshake_response_, host_, "/",
 				std::bind(&client_tcp_session::on_handshake, this,
 					std::placeholders::_1));
 		}
@@ -84,24 +110,15 @@ namespace websocket {
 			if (ec)
 				return exception_log("handshake", ec);
 
-			do_send_alive();
+			on_compression_negotiated(handshake_response_);
+			handshake_response_ = boost::beast::websocket::response_type();
+
+			start_keepalive();
 
 			// Send the message
 			if (connected_handler_) {
 				connected_handler_(shared_from_this());
 			}
 		}
-
-		void do_send_alive() {
-			timer_.expires_from_now(std::chrono::seconds(5));
-			timer_.async_wait([this](boost::system::error_code ec) {
-				if (ec) {
-					return;
-				}
-
-				send(boost::lexical_cast<std::string>(get_now_epoch()));
-				do_send_alive();
-			});
-		}
 	};
 }
\ No newline at end of file
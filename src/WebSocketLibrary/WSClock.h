@@ -0,0 +1,185 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+namespace websocket {
+	// Clock for hot paths. A ticker thread refreshes it once per resolution,
+	// so readers load an atomic instead of querying the system clock, and
+	// the log timestamp is formatted once per second instead of per line.
+	class CoarseClock {
+		static constexpr size_t text_words = 4;
+
+		struct state {
+			std::chrono::steady_clock::time_point start_;
+			std::atomic<uint64_t> steady_ms_;
+			std::atomic<uint64_t> epoch_seconds_;
+			std::atomic<int64_t> resolution_ms_;
+			std::atomic<bool> stop_;
+
+			// "%Y-%m-%d %H:%M:%S " of epoch_seconds_, guarded by a sequence lock
+			std::atomic<uint32_t> sequence_;
+			std::atomic<uint32_t> text_length_;
+			std::atomic<uint64_t> text_[text_words];
+
+			state()
+				: start_(std::chrono::steady_clock::now())
+				, steady_ms_(0)
+				, epoch_seconds_(0)
+				, resolution_ms_(10)
+				, stop_(false)
+				, sequence_(0)
+				, text_length_(0) {
+				for (auto& word : text_) {
+					word.store(0, std::memory_order_relaxed);
+				}
+			}
+		};
+
+		std::shared_ptr<state> state_;
+		std::thread thread_;
+
+	public:
+		// Longest text returned by timestamp()
+		static constexpr size_t max_timestamp = text_words * sizeof(uint64_t);
+
+		CoarseClock()
+			: state_(std::make_shared<state>())
+		{
+			update(*state_);
+			thread_ = std::thread([s = state_]() { run(s); });
+		}
+
+		~CoarseClock() {
+			// Never block process exit, the thread owns its state
+			state_->stop_ = true;
+			if (thread_.joinable()) {
+				thread_.detach();
+			}
+		}
+
+		static CoarseClock& instance() {
+			static CoarseClock clock;
+			return clock;
+		}
+
+		// Staleness of every value, 10 ms by default
+		void set_resolution(std::chrono::milliseconds resolution) {
+			state_->resolution_ms_ = std::max<int64_t>(1, resolution.count());
+		}
+
+		// Monotonic time since the clock started
+		uint64_t steady_ms() const {
+			return state_->steady_ms_.load(std::memory_order_relaxed);
+		}
+
+		uint64_t steady_seconds() const {
+			return steady_ms() / 1000;
+		}
+
+		// Wall clock seconds since the epoch
+		uint64_t epoch_seconds() const {
+			return state_->epoch_seconds_.load(std::memory_order_relaxed);
+		}
+
+		// Copy the local time text into out, return its length
+		size_t timestamp(char* out, size_t size) const {
+			const state& s = *state_;
+			uint64_t words[text_words];
+			uint32_t length;
+			for (;;) {
+				uint32_t before = s.sequence_.load(std::memory_order_acquire);
+				if (before & 1) {
+					std::this_thread::yield();
+					continue;
+				}
+				for (size_t i = 0; i < text_words; ++i) {
+					words[i] = s.text_[i].load(std::memory_order_relaxed);
+				}
+				length = s.text_length_.load(std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (s.sequence_.load(std::memory_order_relaxed) == before) {
+					break;
+				}
+			}
+			size_t count = std::min<size_t>(std::min<size_t>(length, size), max_timestamp);
+			std::memcpy(out, words, count);
+			return count;
+		}
+
+		std::string timestamp() const {
+			char text[max_timestamp];
+			return std::string(text, timestamp(text, sizeof(text)));
+		}
+
+	private:
+		static void run(std::shared_ptr<state> s) {
+			while (!s->stop_) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(s->resolution_ms_.load()));
+				update(*s);
+			}
+		}
+
+		static void update(state& s) {
+			auto elapsed = std::chrono::steady_clock::now() - s.start_;
+			s.steady_ms_.store(static_cast<uint64_t>(
+				std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()), std::memory_order_relaxed);
+
+			std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+			if (static_cast<uint64_t>(now) == s.epoch_seconds_.load(std::memory_order_relaxed)) {
+				return;
+			}
+
+			uint64_t words[text_words] = {};
+			char* text = reinterpret_cast<char*>(words);
+			size_t length = std::strftime(text, max_timestamp, "%Y-%m-%d %H:%M:%S ", std::localtime(&now));
+
+			uint32_t sequence = s.sequence_.load(std::memory_order_relaxed);
+			s.sequence_.store(sequence + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			for (size_t i = 0; i < text_words; ++i) {
+				s.text_[i].store(words[i], std::memory_order_relaxed);
+			}
+			s.text_length_.store(static_cast<uint32_t>(length), std::memory_order_relaxed);
+			s.sequence_.store(sequence + 2, std::memory_order_release);
+
+			s.epoch_seconds_.store(static_cast<uint64_t>(now), std::memory_order_relaxed);
+		}
+	};
+
+	// CPU time of the calling thread in nanoseconds, for measuring work
+	// that interleaves with other handlers on the same thread
+	inline uint64_t thread_cpu_ns() {
+#if defined(_WIN32)
+		FILETIME creation, exit, kernel, user;
+		if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+			return 0;
+		}
+		uint64_t ticks = (static_cast<uint64_t>(kernel.dwHighDateTime) << 32 | kernel.dwLowDateTime) +
+			(static_cast<uint64_t>(user.dwHighDateTime) << 32 | user.dwLowDateTime);
+		return ticks * 100;
+#else
+		timespec now;
+		if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) {
+			return 0;
+		}
+		return static_cast<uint64_t>(now.tv_sec) * 1000000000 + static_cast<uint64_t>(now.tv_nsec);
+#endif
+	}
+}
@@ -0,0 +1,225 @@
+#pragma once
+#include <boost/beast/core.hpp>
+#include <boost/beast/http/rfc7230.hpp>
+#include <boost/beast/websocket/option.hpp>
+#include <boost/beast/websocket/rfc6455.hpp>
+#include <boost/beast/websocket/teardown.hpp>
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "WSClock.h"
+#include "WSDefinition.h"
+
+namespace websocket {
+	// Beast compresses every message once permessage-deflate is negotiated
+	// unless its option has msg_size_threshold, older releases have none
+	template<typename T, typename = void>
+	struct has_msg_size_threshold : std::false_type {};
+
+	template<typename T>
+	struct has_msg_size_threshold<T, std::void_t<decltype(std::declval<T&>().msg_size_threshold)>> : std::true_type {};
+
+	constexpr bool is_compression_threshold_supported =
+		has_msg_size_threshold<boost::beast::websocket::permessage_deflate>::value;
+
+	template<typename Option>
+	void set_msg_size_threshold(Option& option, std::size_t threshold, std::true_type) {
+		option.msg_size_threshold = threshold;
+	}
+
+	template<typename Option>
+	void set_msg_size_threshold(Option&, std::size_t, std::false_type) {
+	}
+
+	// Offer of options for either role
+	inline boost::beast::websocket::permessage_deflate make_permessage_deflate(const compression_options& options) {
+		boost::beast::websocket::permessage_deflate option;
+		option.server_enable = options.enable;
+		option.client_enable = options.enable;
+		option.server_max_window_bits = (std::min)(15, (std::max)(9, options.server_max_window_bits));
+		option.client_max_window_bits = (std::min)(15, (std::max)(9, options.client_max_window_bits));
+		option.server_no_context_takeover = options.server_no_context_takeover;
+		option.client_no_context_takeover = options.client_no_context_takeover;
+		option.compLevel = (std::min)(9, (std::max)(0, options.level));
+		option.memLevel = (std::min)(9, (std::max)(1, options.memory_level));
+		set_msg_size_threshold(option, options.threshold,
+			std::integral_constant<bool, is_compression_threshold_supported>());
+		return option;
+	}
+
+	// Whether the handshake response accepted permessage-deflate
+	template<typename Response>
+	bool is_deflate_negotiated(const Response& res) {
+		if (res.result() != boost::beast::http::status::switching_protocols) {
+			return false;
+		}
+		auto itor = res.find(boost::beast::http::field::sec_websocket_extensions);
+		return itor != res.end() && boost::beast::http::ext_list(itor->value()).exists("permessage-deflate");
+	}
+
+	// Bytes written by a websocket stream, and the thread CPU time it spent
+	// between resume() and its next write, which is where it deflates and
+	// frames a message. Only touched on the session strand.
+	struct write_meter {
+		uint64_t bytes = 0;
+		uint64_t cpu_ns = 0;
+		uint64_t segment_start = 0;
+		bool is_active = false;
+
+		void resume() {
+			if (is_active) {
+				segment_start = thread_cpu_ns();
+			}
+		}
+
+		void pause() {
+			if (segment_start != 0) {
+				cpu_ns += thread_cpu_ns() - segment_start;
+				segment_start = 0;
+			}
+		}
+
+		void discard() {
+			segment_start = 0;
+		}
+	};
+
+	template<typename Handler>
+	class metered_write_handler {
+	public:
+		Handler handler_;
+		std::shared_ptr<write_meter> meter_;
+
+		metered_write_handler(Handler&& handler, std::shared_ptr<write_meter> meter)
+			: handler_(std::move(handler))
+			, meter_(std::move(meter)) {
+		}
+
+		void operator()(boost::beast::error_code ec, std::size_t bytes_transferred) {
+			meter_->bytes += bytes_transferred;
+			meter_->resume();
+			handler_(ec, bytes_transferred);
+			meter_->discard();
+		}
+	};
+
+	// Stream below a websocket stream, counts its writes into a write_meter
+	// once one is set. Without a meter it only forwards.
+	template<typename NextLayer>
+	class metered_stream {
+	public:
+		using next_layer_type = NextLayer;
+		using executor_type = typename NextLayer::executor_type;
+
+	private:
+		NextLayer next_;
+		std::shared_ptr<write_meter> meter_;
+
+	public:
+		template<typename... Args>
+		explicit metered_stream(Args&&... args)
+			: next_(std::forward<Args>(args)...) {
+		}
+
+		executor_type get_executor() noexcept {
+			return next_.get_executor();
+		}
+
+		next_layer_type& next_layer() noexcept {
+			return next_;
+		}
+
+		const next_layer_type& next_layer() const noexcept {
+			return next_;
+		}
+
+		void set_write_meter(std::shared_ptr<write_meter> meter) {
+			meter_ = std::move(meter);
+		}
+
+		const std::shared_ptr<write_meter>& get_write_meter() const {
+			return meter_;
+		}
+
+		template<typename MutableBufferSequence>
+		std::size_t read_some(const MutableBufferSequence& buffers) {
+			return next_.read_some(buffers);
+		}
+
+		template<typename MutableBufferSequence>
+		std::size_t read_some(const MutableBufferSequence& buffers, boost::beast::error_code& ec) {
+			return next_.read_some(buffers, ec);
+		}
+
+		template<typename ConstBufferSequence>
+		std::size_t write_some(const ConstBufferSequence& buffers) {
+			std::size_t bytes = next_.write_some(buffers);
+			if (meter_) {
+				meter_->bytes += bytes;
+			}
+			return bytes;
+		}
+
+		template<typename ConstBufferSequence>
+		std::size_t write_some(const ConstBufferSequence& buffers, boost::beast::error_code& ec) {
+			std::size_t bytes = next_.write_some(buffers, ec);
+			if (meter_) {
+				meter_->bytes += bytes;
+			}
+			return bytes;
+		}
+
+		template<typename MutableBufferSequence, typename ReadHandler>
+		auto async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler) {
+			return next_.async_read_some(buffers, std::forward<ReadHandler>(handler));
+		}
+
+		template<typename ConstBufferSequence, typename WriteHandler>
+		void async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler) {
+			if (!meter_) {
+				next_.async_write_some(buffers, std::forward<WriteHandler>(handler));
+				return;
+			}
+			meter_->pause();
+			next_.async_write_some(buffers, metered_write_handler<typename std::decay<WriteHandler>::type>(
+				std::forward<WriteHandler>(handler), meter_));
+		}
+	};
+
+	template<typename NextLayer, typename TeardownHandler>
+	void async_teardown(boost::beast::role_type role, metered_stream<NextLayer>& stream, TeardownHandler&& handler) {
+		using boost::beast::websocket::async_teardown;
+		async_teardown(role, stream.next_layer(), std::forward<TeardownHandler>(handler));
+	}
+
+	template<typename NextLayer>
+	void teardown(boost::beast::role_type role, metered_stream<NextLayer>& stream, boost::beast::error_code& ec) {
+		using boost::beast::websocket::teardown;
+		teardown(role, stream.next_layer(), ec);
+	}
+}
+
+namespace boost {
+	namespace asio {
+		// The meter must not change where or how the handler runs
+		template<typename Handler, typename Executor>
+		struct associated_executor<websocket::metered_write_handler<Handler>, Executor> {
+			using type = typename associated_executor<Handler, Executor>::type;
+
+			static type get(const websocket::metered_write_handler<Handler>& handler, const Executor& executor = Executor()) noexcept {
+				return associated_executor<Handler, Executor>::get(handler.handler_, executor);
+			}
+		};
+
+		template<typename Handler, typename Allocator>
+		struct associated_allocator<websocket::metered_write_handler<Handler>, Allocator> {
+			using type = typename associated_allocator<Handler, Allocator>::type;
+
+			static type get(const websocket::metered_write_handler<Handler>& handler, const Allocator& allocator = Allocator()) noexcept {
+				return associated_allocator<Handler, Allocator>::get(handler.handler_, allocator);
+			}
+		};
+	}
+}
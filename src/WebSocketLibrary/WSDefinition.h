@@ -1,7 +1,10 @@
 #pragma once
+#include <algorithm>
+#include <chrono>
 #include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
 
 #include <boost/beast/core/error.hpp>
 #include <boost/asio/ssl/context.hpp>
@@ -15,10 +18,112 @@ namespace websocket {
 			std::size_t, std::string&&, 
 			std::shared_ptr<T>)>;
 
+	// The view refers to the session read buffer and is only valid until
+	// the handler returns, the data is followed by a '\0'.
+	template<typename T> using AsyncReadViewHandler =
+		std::function<void(boost::beast::error_code,
+			std::size_t, std::string_view,
+			std::shared_ptr<T>)>;
+
 	template<typename T> using AsyncWriteHandler = 
 		std::function<void(boost::beast::error_code,
 		std::size_t, std::shared_ptr<T>)>;
 
+	// Invoked with true when a session write queue rises above the high
+	// watermark and with false once it drains below the low watermark.
+	// Runs on the session strand after send returned, so it may send,
+	// broadcast or publish.
+	template<typename T> using WatermarkHandler =
+		std::function<void(bool, std::shared_ptr<T>)>;
+
 	using SSLContext = std::shared_ptr<boost::asio::ssl::context>;
 
-}
\ No newline at end of file
+	// Sessions receiving nothing for this long are closed
+	constexpr std::chrono::seconds default_idle_timeout(15);
+
+	// Interval of client keepalive pings, servers do not ping by default
+	constexpr std::chrono::seconds default_ping_interval(5);
+
+	// Upper bound of bytes drained from the write queue in one batch
+	constexpr std::size_t default_max_batch_bytes = 64 * 1024;
+
+	// What to do when a send would exceed the write queue limits. Messages
+	// sent with a completion handler are never discarded.
+	enum class overflow_policy {
+		reject,			// fail the send, the queue is untouched
+		drop_oldest,	// discard the oldest queued messages to make room
+		conflate,		// discard every queued message, the newest one wins
+		close			// fail the send and close the session
+	};
+
+	// Limits of a session write queue, zero means unlimited.
+	// Queued bytes include the batch currently being written.
+	struct write_queue_limits {
+		std::size_t max_bytes = 0;
+		std::size_t max_messages = 0;
+		std::size_t high_watermark = 0;
+		std::size_t low_watermark = 0;
+		overflow_policy policy = overflow_policy::reject;
+	};
+
+	// Limits checked by listeners before a connection becomes a session,
+	// zero means unlimited. A listener stops accepting while the server
+	// is full, connections above the per address cap are closed.
+	struct admission_limits {
+		std::size_t max_connections = 0;
+		std::size_t max_connections_per_ip = 0;
+		std::size_t max_pending_handshakes = 0;
+		std::size_t accept_rate = 0;	// connections per second
+		std::size_t accept_burst = 0;	// defaults to accept_rate
+	};
+
+	// TCP tuning of listening, accepted and client sockets. Zero keeps the
+	// system default, options the platform lacks are skipped.
+	struct socket_options {
+		bool no_delay = true;			// send small frames without waiting for acks
+		bool quick_ack = true;			// ack at once instead of delaying, Linux only
+		int send_buffer_size = 0;
+		int receive_buffer_size = 0;
+
+		bool keep_alive = false;
+		std::chrono::seconds keep_alive_idle{ 0 };
+		std::chrono::seconds keep_alive_interval{ 0 };
+		int keep_alive_count = 0;
+
+		// Drop the connection when sent data stays unacknowledged this long, Linux only
+		std::chrono::milliseconds user_timeout{ 0 };
+
+		// Listener only. Wake accept once the request arrived, Linux only
+		std::chrono::seconds defer_accept{ 0 };
+		int backlog = 0;				// zero is the system maximum
+	};
+
+	// Server side TLS session resumption, see enable_tls_resumption
+	struct tls_resumption_options {
+		std::size_t cache_size = 20480;					// sessions kept in memory, zero disables the cache
+		std::chrono::seconds timeout{ 7200 };			// lifetime of a cached session or ticket
+		bool tickets = true;
+		std::chrono::seconds ticket_key_rotation{ 3600 };
+	};
+
+	// permessage-deflate, used when both sides of a session enable it. Every
+	// compressing session keeps about (1 << (window_bits + 2)) + (1 << (memory_level + 9))
+	// bytes for deflate and (1 << window_bits) for inflate, see compression_memory.
+	struct compression_options {
+		bool enable = false;
+		int server_max_window_bits = 15;	// 9..15
+		int client_max_window_bits = 15;
+		bool server_no_context_takeover = false;	// reset the window after every message
+		bool client_no_context_takeover = false;
+		int level = 8;						// zlib level 0..9
+		int memory_level = 4;				// zlib memory level 1..9
+		std::size_t threshold = 128;		// smaller messages are sent uncompressed, needs msg_size_threshold of Beast
+	};
+
+	// Approximate zlib memory of one compressing session, both directions
+	inline std::size_t compression_memory(const compression_options& options) {
+		int window_bits = (std::max)(options.server_max_window_bits, options.client_max_window_bits);
+		return (std::size_t(1) << (window_bits + 2)) + (std::size_t(1) << (options.memory_level + 9)) +
+			(std::size_t(1) << window_bits);
+	}
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/strand.hpp>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "WSMetrics.h"
+#include "WSUtility.h"
+
+namespace websocket {
+	// Threads running TLS handshakes apart from the io threads of the
+	// established sessions, so a burst of new connections does not delay
+	// their messages. Sockets stay on their io_context, only the handshake
+	// computation runs here.
+	class HandshakePool : public std::enable_shared_from_this<HandshakePool> {
+	public:
+		using executor_type = boost::asio::strand<boost::asio::io_context::executor_type>;
+
+		// Held while a handshake is queued or running
+		class slot {
+			std::shared_ptr<HandshakePool> pool_;
+		public:
+			explicit slot(std::shared_ptr<HandshakePool> pool)
+				: pool_(std::move(pool)) {
+				pool_->pending_.add();
+			}
+
+			~slot() {
+				pool_->release();
+			}
+		};
+
+	private:
+		std::unique_ptr<boost::asio::io_context> ioc_;
+		std::unique_ptr<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> work_;
+		ThreadGroup threads_;
+		std::size_t max_pending_;
+
+		Gauge pending_;
+		Counter saturated_;
+
+		// Paused listeners, resumed once the queue is below max_pending_
+		std::mutex mutex_;
+		std::vector<std::function<void()>> waiters_;
+
+	public:
+		// max_pending of zero never pauses accepting
+		explicit HandshakePool(std::size_t thread_count, std::size_t max_pending = 0)
+			: ioc_(std::make_unique<boost::asio::io_context>(static_cast<int>(thread_count)))
+			, max_pending_(max_pending)
+		{
+			work_ = std::make_unique<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>>(
+				boost::asio::make_work_guard(*ioc_));
+			auto context = ioc_.get();
+			threads_.create_thread_count([context]() { context->run(); }, std::max<std::size_t>(1, thread_count));
+		}
+
+		~HandshakePool() {
+			stop();
+		}
+
+		// Drops queued handshakes, call before the io_contexts of their
+		// sessions are destroyed
+		void stop() {
+			if (!ioc_) {
+				return;
+			}
+			work_.reset();
+			ioc_->stop();
+			threads_.join_and_clear_all();
+			ioc_.reset();
+		}
+
+		// Strand of one handshake
+		executor_type make_strand() {
+			return boost::asio::make_strand(*ioc_);
+		}
+
+		std::unique_ptr<slot> enter() {
+			return std::make_unique<slot>(shared_from_this());
+		}
+
+		// Handshakes queued or running
+		int64_t pending() const {
+			return pending_.value();
+		}
+
+		// Times a listener paused because the queue was full
+		uint64_t saturated() const {
+			return saturated_.value();
+		}
+
+		bool is_saturated() const {
+			return max_pending_ != 0 && pending_.value() >= static_cast<int64_t>(max_pending_);
+		}
+
+		// Call resume once the queue has room, return false if it has room
+		// already and the caller should go on now.
+		bool wait(std::function<void()>&& resume) {
+			std::lock_guard<std::mutex> guard(mutex_);
+			if (!is_saturated()) {
+				return false;
+			}
+			saturated_.add();
+			waiters_.emplace_back(std::move(resume));
+			return true;
+		}
+
+	private:
+		void release() {
+			pending_.sub();
+
+			std::vector<std::function<void()>> waiters;
+			{
+				std::lock_guard<std::mutex> guard(mutex_);
+				if (waiters_.empty() || is_saturated()) {
+					return;
+				}
+				waiters.swap(waiters_);
+			}
+			for (auto& resume : waiters) {
+				resume();
+			}
+		}
+	};
+}
@@ -0,0 +1,558 @@
+#pragma once
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace websocket {
+	// Small JSON reader and writer for the key handshake messages. parse
+	// validates the text once and returns views into it, nothing is copied
+	// or allocated until a string is asked for with escapes in it.
+	namespace json {
+		enum class kind {
+			invalid,
+			null,
+			boolean,
+			number,
+			string,
+			array,
+			object
+		};
+
+		namespace detail {
+			// Nesting deeper than this is refused instead of risking the stack
+			const int max_depth = 64;
+
+			inline bool is_space(char c) {
+				return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+			}
+
+			inline bool is_digit(char c) {
+				return c >= '0' && c <= '9';
+			}
+
+			inline const char* skip_space(const char* p, const char* end) {
+				while (p != end && is_space(*p)) {
+					++p;
+				}
+				return p;
+			}
+
+			inline int hex_value(char c) {
+				if (c >= '0' && c <= '9') return c - '0';
+				if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+				if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+				return -1;
+			}
+
+			inline bool read_hex4(const char* p, const char* end, unsigned& code) {
+				if (end - p < 4) {
+					return false;
+				}
+				code = 0;
+				for (int i = 0; i < 4; ++i) {
+					int digit = hex_value(p[i]);
+					if (digit < 0) {
+						return false;
+					}
+					code = (code << 4) | static_cast<unsigned>(digit);
+				}
+				return true;
+			}
+
+			// p at the opening quote, returns past the closing quote or nullptr
+			inline const char* skip_string(const char* p, const char* end) {
+				for (++p; p != end; ++p) {
+					char c = *p;
+					if (c == '"') {
+						return p + 1;
+					}
+					if (static_cast<unsigned char>(c) < 0x20) {
+						return nullptr;
+					}
+					if (c == '\\') {
+						if (++p == end) {
+							return nullptr;
+						}
+						unsigned code;
+						switch (*p) {
+						case '"': case '\\': case '/': case 'b':
+						case 'f': case 'n': case 'r': case 't':
+							break;
+						case 'u':
+							if (!read_hex4(p + 1, end, code)) {
+								return nullptr;
+							}
+							p += 4;
+							break;
+						default:
+							return nullptr;
+						}
+					}
+				}
+				return nullptr;
+			}
+
+			inline const char* skip_digits(const char* p, const char* end) {
+				const char* begin = p;
+				while (p != end && is_digit(*p)) {
+					++p;
+				}
+				return p == begin ? nullptr : p;
+			}
+
+			inline const char* skip_number(const char* p, const char* end) {
+				if (p != end && *p == '-') {
+					++p;
+				}
+				if (p != end && *p == '0') {
+					++p;
+				}
+				else if (!(p = skip_digits(p, end))) {
+					return nullptr;
+				}
+				if (p != end && *p == '.') {
+					if (!(p = skip_digits(p + 1, end))) {
+						return nullptr;
+					}
+				}
+				if (p != end && (*p == 'e' || *p == 'E')) {
+					++p;
+					if (p != end && (*p == '+' || *p == '-')) {
+						++p;
+					}
+					if (!(p = skip_digits(p, end))) {
+						return nullptr;
+					}
+				}
+				return p;
+			}
+
+			inline const char* skip_literal(const char* p, const char* end, std::string_view literal) {
+				if (static_cast<std::size_t>(end - p) < literal.size() ||
+					std::string_view(p, literal.size()) != literal) {
+					return nullptr;
+				}
+				return p + literal.size();
+			}
+
+			inline kind kind_of(char c) {
+				switch (c) {
+				case '{': return kind::object;
+				case '[': return kind::array;
+				case '"': return kind::string;
+				case 't': case 'f': return kind::boolean;
+				case 'n': return kind::null;
+				default: return kind::number;
+				}
+			}
+
+			// p at the first character of a value, returns past it or nullptr
+			inline const char* skip_value(const char* p, const char* end, int depth) {
+				if (p == end) {
+					return nullptr;
+				}
+				switch (*p) {
+				case '"':
+					return skip_string(p, end);
+				case 't':
+					return skip_literal(p, end, "true");
+				case 'f':
+					return skip_literal(p, end, "false");
+				case 'n':
+					return skip_literal(p, end, "null");
+				case '{':
+				case '[': {
+					if (depth >= max_depth) {
+						return nullptr;
+					}
+					const bool is_object = *p == '{';
+					const char close = is_object ? '}' : ']';
+					p = skip_space(p + 1, end);
+					if (p != end && *p == close) {
+						return p + 1;
+					}
+					while (p != end) {
+						if (is_object) {
+							if (*p != '"' || !(p = skip_string(p, end))) {
+								return nullptr;
+							}
+							p = skip_space(p, end);
+							if (p == end || *p != ':') {
+								return nullptr;
+							}
+							p = skip_space(p + 1, end);
+						}
+						if (!(p = skip_value(p, end, depth + 1))) {
+							return nullptr;
+						}
+						p = skip_space(p, end);
+						if (p == end) {
+							return nullptr;
+						}
+						if (*p == close) {
+							return p + 1;
+						}
+						if (*p != ',') {
+							return nullptr;
+						}
+						p = skip_space(p + 1, end);
+					}
+					return nullptr;
+				}
+				default:
+					return skip_number(p, end);
+				}
+			}
+
+			inline void append_utf8(unsigned code, std::string& out) {
+				if (code < 0x80) {
+					out += static_cast<char>(code);
+				}
+				else if (code < 0x800) {
+					out += static_cast<char>(0xc0 | (code >> 6));
+					out += static_cast<char>(0x80 | (code & 0x3f));
+				}
+				else if (code < 0x10000) {
+					out += static_cast<char>(0xe0 | (code >> 12));
+					out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+					out += static_cast<char>(0x80 | (code & 0x3f));
+				}
+				else {
+					out += static_cast<char>(0xf0 | (code >> 18));
+					out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+					out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+					out += static_cast<char>(0x80 | (code & 0x3f));
+				}
+			}
+
+			// Unescape the content of a validated string into out
+			inline void unescape(const char* p, const char* end, std::string& out) {
+				out.clear();
+				out.reserve(end - p);
+				while (p != end) {
+					if (*p != '\\') {
+						out += *p++;
+						continue;
+					}
+					++p;
+					switch (*p++) {
+					case 'b': out += '\b'; break;
+					case 'f': out += '\f'; break;
+					case 'n': out += '\n'; break;
+					case 'r': out += '\r'; break;
+					case 't': out += '\t'; break;
+					case 'u': {
+						unsigned code = 0;
+						read_hex4(p, end, code);
+						p += 4;
+						// Surrogate pair, a lone half is kept as is
+						unsigned low = 0;
+						if (code >= 0xd800 && code < 0xdc00 && end - p >= 6 &&
+							p[0] == '\\' && p[1] == 'u' && read_hex4(p + 2, end, low) &&
+							low >= 0xdc00 && low < 0xe000) {
+							code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+							p += 6;
+						}
+						append_utf8(code, out);
+						break;
+					}
+					default: out += p[-1];
+					}
+				}
+			}
+		}
+
+		// View of one value of a parsed text, valid as long as the text
+		class value {
+			const char* begin_;
+			const char* end_;
+			kind kind_;
+
+		public:
+			value()
+				: begin_(nullptr)
+				, end_(nullptr)
+				, kind_(kind::invalid) {}
+
+			value(const char* begin, const char* end)
+				: begin_(begin)
+				, end_(end)
+				, kind_(detail::kind_of(*begin)) {}
+
+			kind type() const { return kind_; }
+			bool is_valid() const { return kind_ != kind::invalid; }
+			bool is_object() const { return kind_ == kind::object; }
+			bool is_array() const { return kind_ == kind::array; }
+			bool is_string() const { return kind_ == kind::string; }
+			bool is_number() const { return kind_ == kind::number; }
+
+			// Text of the value as written, strings with their quotes
+			std::string_view raw() const {
+				return std::string_view(begin_, end_ - begin_);
+			}
+
+			// Member of an object, invalid if absent or not an object
+			value operator[](std::string_view key) const {
+				value found;
+				visit_members([&](const value& name, const value& member) {
+					if (!name.equals(key)) {
+						return true;
+					}
+					found = member;
+					return false;
+				});
+				return found;
+			}
+
+			// f(name, value) for every member of an object, name is a string
+			template<typename F>
+			void for_each_member(F&& f) const {
+				visit_members([&](const value& name, const value& member) {
+					f(name, member);
+					return true;
+				});
+			}
+
+			// f(value) for every element of an array
+			template<typename F>
+			void for_each(F&& f) const {
+				if (kind_ != kind::array) {
+					return;
+				}
+				const char* p = detail::skip_space(begin_ + 1, end_);
+				while (*p != ']') {
+					const char* value_end = detail::skip_value(p, end_, 0);
+					f(value(p, value_end));
+					p = detail::skip_space(value_end, end_);
+					if (*p == ',') {
+						p = detail::skip_space(p + 1, end_);
+					}
+				}
+			}
+
+			// String content without unescaping, false if it has escapes
+			bool get(std::string_view& out) const {
+				if (kind_ != kind::string) {
+					return false;
+				}
+				std::string_view content(begin_ + 1, end_ - begin_ - 2);
+				if (content.find('\\') != std::string_view::npos) {
+					return false;
+				}
+				out = content;
+				return true;
+			}
+
+			bool get(std::string& out) const {
+				if (kind_ != kind::string) {
+					return false;
+				}
+				std::string_view content;
+				if (get(content)) {
+					out.assign(content.data(), content.size());
+				}
+				else {
+					detail::unescape(begin_ + 1, end_ - 1, out);
+				}
+				return true;
+			}
+
+			// A non-negative integer, written as a number or as a string of
+			// digits like property_tree writes them
+			bool get(std::uint64_t& out) const {
+				const char* first = begin_;
+				const char* last = end_;
+				if (kind_ == kind::string) {
+					++first;
+					--last;
+				}
+				else if (kind_ != kind::number) {
+					return false;
+				}
+				if (first == last) {
+					return false;
+				}
+				auto result = std::from_chars(first, last, out);
+				return result.ec == std::errc() && result.ptr == last;
+			}
+
+			bool get(bool& out) const {
+				if (kind_ != kind::boolean) {
+					return false;
+				}
+				out = *begin_ == 't';
+				return true;
+			}
+
+			// Compare a string with text, escapes are decoded only when present
+			bool equals(std::string_view text) const {
+				std::string_view content;
+				if (get(content)) {
+					return content == text;
+				}
+				std::string decoded;
+				return get(decoded) && decoded == text;
+			}
+
+		private:
+			// Until f(name, value) returns false
+			template<typename F>
+			void visit_members(F&& f) const {
+				if (kind_ != kind::object) {
+					return;
+				}
+				const char* p = detail::skip_space(begin_ + 1, end_);
+				while (*p != '}') {
+					const char* name_end = detail::skip_string(p, end_);
+					value name(p, name_end);
+					p = detail::skip_space(detail::skip_space(name_end, end_) + 1, end_);
+					const char* value_end = detail::skip_value(p, end_, 0);
+					if (!f(name, value(p, value_end))) {
+						return;
+					}
+					p = detail::skip_space(value_end, end_);
+					if (*p == ',') {
+						p = detail::skip_space(p + 1, end_);
+					}
+				}
+			}
+		};
+
+		// Validate text and return its root, invalid unless text is one JSON value
+		inline value parse(std::string_view text) {
+			const char* end = text.data() + text.size();
+			const char* begin = detail::skip_space(text.data(), end);
+			const char* value_end = detail::skip_value(begin, end, 0);
+			if (!value_end || detail::skip_space(value_end, end) != end) {
+				return value();
+			}
+			return value(begin, value_end);
+		}
+
+		// Appends compact JSON to a string, the caller nests the calls
+		// correctly, e.g. writer(out).begin_object().key("a").number(1).end_object()
+		class writer {
+			std::string& out_;
+			// Whether the current container has a value yet, one bit per depth
+			std::uint64_t has_value_;
+			int depth_;
+			bool after_key_;
+
+		public:
+			explicit writer(std::string& out)
+				: out_(out)
+				, has_value_(0)
+				, depth_(0)
+				, after_key_(false) {}
+
+			writer& begin_object() {
+				return open('{');
+			}
+
+			writer& end_object() {
+				return close('}');
+			}
+
+			writer& begin_array() {
+				return open('[');
+			}
+
+			writer& end_array() {
+				return close(']');
+			}
+
+			writer& key(std::string_view name) {
+				separate();
+				quote(name);
+				out_ += ':';
+				after_key_ = true;
+				return *this;
+			}
+
+			writer& string(std::string_view text) {
+				separate();
+				quote(text);
+				return *this;
+			}
+
+			writer& number(std::uint64_t number) {
+				separate();
+				char buffer[24];
+				auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+				out_.append(buffer, result.ptr);
+				return *this;
+			}
+
+			writer& boolean(bool value) {
+				separate();
+				out_ += value ? "true" : "false";
+				return *this;
+			}
+
+			// Already serialized JSON, written as is
+			writer& raw(std::string_view json) {
+				separate();
+				out_.append(json.data(), json.size());
+				return *this;
+			}
+
+		private:
+			writer& open(char c) {
+				separate();
+				out_ += c;
+				++depth_;
+				has_value_ &= ~(std::uint64_t(1) << (depth_ & 63));
+				return *this;
+			}
+
+			writer& close(char c) {
+				out_ += c;
+				--depth_;
+				return *this;
+			}
+
+			void separate() {
+				if (after_key_) {
+					after_key_ = false;
+					return;
+				}
+				const std::uint64_t bit = std::uint64_t(1) << (depth_ & 63);
+				if (has_value_ & bit) {
+					out_ += ',';
+				}
+				has_value_ |= bit;
+			}
+
+			void quote(std::string_view text) {
+				static const char hex[] = "0123456789abcdef";
+				out_ += '"';
+				const char* clean = text.data();
+				const char* end = text.data() + text.size();
+				for (const char* p = clean; p != end; ++p) {
+					const unsigned char c = static_cast<unsigned char>(*p);
+					if (c >= 0x20 && c != '"' && c != '\\') {
+						continue;
+					}
+					out_.append(clean, p);
+					clean = p + 1;
+					switch (c) {
+					case '"': out_ += "\\\""; break;
+					case '\\': out_ += "\\\\"; break;
+					case '\n': out_ += "\\n"; break;
+					case '\r': out_ += "\\r"; break;
+					case '\t': out_ += "\\t"; break;
+					case '\b': out_ += "\\b"; break;
+					case '\f': out_ += "\\f"; break;
+					default:
+						out_ += "\\u00";
+						out_ += hex[c >> 4];
+						out_ += hex[c & 0xf];
+					}
+				}
+				out_.append(clean, end);
+				out_ += '"';
+			}
+		};
+	}
+}
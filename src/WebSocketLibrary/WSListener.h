@@ -1,6 +1,9 @@
 #pragma once
+#include "WSAdmission.h"
 #include "WSDefinition.h"
 #include "WSServerSession.h"
+#include "WSSocket.h"
+#include "WSTLS.h"
 #include "WSUtility.h"
 
 namespace websocket {
@@ -18,7 +21,44 @@ namespace websocket {
 
 		OnConnectionCompleted<base_session_type> accepted_handler_;
 
+		// Swapped atomically, new handshakes use the latest context
 		std::shared_ptr<boost::asio::ssl::context> ssl_context_;
+
+		bool write_batching_;
+		std::size_t max_batch_bytes_;
+
+		write_queue_limits write_limits_;
+		WatermarkHandler<base_session_type> watermark_handler_;
+
+		// Shared by the idle timeouts of every accepted session
+		std::chrono::milliseconds idle_timeout_;
+		std::chrono::milliseconds ping_interval_;
+		std::shared_ptr<TimingWheel> idle_wheel_;
+
+		// Thread per core mode, see set_reuse_port and set_use_strand
+		bool reuse_port_;
+		bool use_strand_;
+		std::vector<boost::asio::io_context*> worker_contexts_;
+		std::vector<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> worker_guards_;
+		std::size_t next_worker_;
+
+		socket_options socket_options_;
+
+		// May be shared with the listeners of other cores
+		std::shared_ptr<handshake_metrics> handshake_metrics_;
+		std::shared_ptr<compression_metrics> compression_metrics_;
+		compression_options compression_;
+
+		// Optional, may be shared with the listeners of other cores
+		std::shared_ptr<HandshakePool> handshake_pool_;
+		std::shared_ptr<AdmissionControl> admission_;
+		boost::asio::steady_timer pause_timer_;
+
+		bool ktls_;
+
+#if defined(SO_REUSEPORT)
+		using reuse_port = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#endif
 	public:
 		Listener(
 			boost::asio::io_context& ioc,
@@ -27,6 +67,18 @@ namespace websocket {
 			, endpoint_(endpoint)
 			, acceptor_(new boost::asio::ip::tcp::acceptor(ioc))
 			, ssl_context_(nullptr)
+			, write_batching_(false)
+			, max_batch_bytes_(default_max_batch_bytes)
+			, idle_timeout_(default_idle_timeout)
+			, ping_interval_(0)
+			, idle_wheel_(std::make_shared<TimingWheel>(ioc))
+			, reuse_port_(false)
+			, use_strand_(true)
+			, next_worker_(0)
+			, handshake_metrics_(std::make_shared<handshake_metrics>())
+			, compression_metrics_(std::make_shared<compression_metrics>())
+			, pause_timer_(ioc)
+			, ktls_(false)
 		{
 		}
 
@@ -43,12 +95,16 @@ namespace websocket {
 				return false;
 			}
 
+			idle_wheel_->start();
 			do_accept();			
 			return true;
 		}
 
 		void stop() {
-			if (acceptor_) {
+			idle_wheel_->stop();
+			worker_guards_.clear();
+			pause_timer_.cancel();
+			if (acceptor_ && acceptor_->is_open()) {
 				boost::system::error_code ec;
 				acceptor_->cancel(ec);
 				if (ec) {
@@ -71,8 +127,137 @@ namespace websocket {
 			accepted_handler_ = std::move(handler);
 		}
 
+		// Applied to every accepted session
+		void set_write_batching(bool enable, std::size_t max_batch_bytes = default_max_batch_bytes) {
+			write_batching_ = enable;
+			max_batch_bytes_ = max_batch_bytes;
+		}
+
+		void set_write_queue_limits(const write_queue_limits& limits) {
+			write_limits_ = limits;
+		}
+
+		void set_watermark_handler(WatermarkHandler<base_session_type>&& handler) {
+			watermark_handler_ = std::move(handler);
+		}
+
+		// Zero disables the idle timeout
+		void set_idle_timeout(std::chrono::milliseconds timeout) {
+			idle_timeout_ = timeout;
+		}
+
+		// Server initiated keepalive, zero leaves pinging to the clients
+		void set_ping_interval(std::chrono::milliseconds interval) {
+			ping_interval_ = interval;
+		}
+
 		void set_ssl_context(boost::asio::ssl::context&& context) {
-			ssl_context_ = std::make_shared<boost::asio::ssl::context>(std::move(context));
+			set_ssl_context(std::make_shared<boost::asio::ssl::context>(std::move(context)));
+		}
+
+		// One context may be shared by the listeners of every core. May be
+		// called while running to rotate certificates, sessions keep the
+		// context they were accepted with.
+		void set_ssl_context(std::shared_ptr<boost::asio::ssl::context> context) {
+			if (ktls_ && context) {
+				ktls::prepare(*context);
+			}
+			std::atomic_store(&ssl_context_, std::move(context));
+		}
+
+		std::shared_ptr<boost::asio::ssl::context> ssl_context() const {
+			return std::atomic_load(&ssl_context_);
+		}
+
+		// TCP tuning of the acceptor and every accepted socket, set before run
+		void set_socket_options(const socket_options& options) {
+			socket_options_ = options;
+		}
+
+		void set_handshake_metrics(std::shared_ptr<handshake_metrics> metrics) {
+			handshake_metrics_ = std::move(metrics);
+		}
+
+		// Full, resumed and failed TLS handshakes of accepted sessions
+		std::shared_ptr<handshake_metrics> get_handshake_metrics() const {
+			return handshake_metrics_;
+		}
+
+		// permessage-deflate for clients that offer it, set before run. A
+		// Beast without msg_size_threshold compresses every message, there
+		// a threshold is logged and cleared.
+		void set_compression(const compression_options& options) {
+			compression_ = options;
+			if (!is_compression_threshold_supported && compression_.enable && compression_.threshold != 0) {
+				exception_log("compression threshold", boost::asio::error::make_error_code(boost::asio::error::operation_not_supported));
+				compression_.threshold = 0;
+			}
+		}
+
+		void set_compression_metrics(std::shared_ptr<compression_metrics> metrics) {
+			compression_metrics_ = std::move(metrics);
+		}
+
+		// Messages sent compressed by accepted sessions
+		std::shared_ptr<compression_metrics> get_compression_metrics() const {
+			return compression_metrics_;
+		}
+
+		// Run TLS handshakes on the pool, accepting pauses while its queue is full
+		void set_handshake_pool(std::shared_ptr<HandshakePool> pool) {
+			handshake_pool_ = std::move(pool);
+		}
+
+		// Move TLS records into the kernel after the handshake where the
+		// cipher and the kernel allow it, see tls_stream::async_enable_ktls.
+		// Set before the SSL context, which it has to prepare.
+		void set_ktls(bool enable) {
+			ktls_ = enable;
+			auto context = std::atomic_load(&ssl_context_);
+			if (ktls_ && context) {
+				ktls::prepare(*context);
+			}
+		}
+
+		// Pause accepting while the limits are reached, see AdmissionControl
+		void set_admission_limits(const admission_limits& limits) {
+			admission_ = std::make_shared<AdmissionControl>(limits);
+		}
+
+		void set_admission_control(std::shared_ptr<AdmissionControl> admission) {
+			admission_ = std::move(admission);
+		}
+
+		std::shared_ptr<AdmissionControl> admission_control() const {
+			return admission_;
+		}
+
+		static constexpr bool is_reuse_port_supported() {
+#if defined(SO_REUSEPORT)
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		// Bind with SO_REUSEPORT so one listener per io_context can share
+		// the endpoint, the kernel spreads new connections across them.
+		void set_reuse_port(bool enable) {
+			reuse_port_ = enable;
+		}
+
+		// Sessions get their own strand by default. An io_context run by a
+		// single thread needs none, every handler already runs in order.
+		void set_use_strand(bool enable) {
+			use_strand_ = enable;
+		}
+
+		// Hand accepted sockets round robin to these contexts instead of the
+		// one of the listener, for platforms without SO_REUSEPORT.
+		void add_worker_context(boost::asio::io_context& ioc) {
+			worker_contexts_.emplace_back(&ioc);
+			// Keep it running while it has no session yet
+			worker_guards_.emplace_back(boost::asio::make_work_guard(ioc));
 		}
 
 	private:
@@ -95,6 +280,27 @@ namespace websocket {
 				return false;
 			}
 
+			if (reuse_port_) {
+#if defined(SO_REUSEPORT)
+				acceptor_->set_option(reuse_port(true), ec);
+				if (ec)
+				{
+					exception_log("set_option", ec);
+					return false;
+				}
+#else
+				log("SO_REUSEPORT is not supported");
+				return false;
+#endif
+			}
+
+			set_listen_options(*acceptor_, socket_options_, ec);
+			if (ec)
+			{
+				exception_log("set_option", ec);
+				return false;
+			}
+
 			// Bind to the server address
 			acceptor_->bind(endpoint_, ec);
 			if (ec)
@@ -104,8 +310,7 @@ namespace websocket {
 			}
 
 			// Start listening for connections
-			acceptor_->listen(
-				boost::asio::socket_base::max_listen_connections, ec);
+			acceptor_->listen(listen_backlog(socket_options_), ec);
 			if (ec)
 			{
 				exception_log("listen", ec);
@@ -117,15 +322,66 @@ namespace websocket {
 		void do_accept()
 		{
 			auto self = Listener<server_session_type, base_session_type>::shared_from_this();
-			// The new connection gets its own strand
-			acceptor_->async_accept(
-				boost::asio::make_strand(ioc_),
-				boost::beast::bind_front_handler(
-					&Listener::on_accept,
-					self));
+			if (!acceptor_->is_open()) {
+				return;
+			}
+
+			// Leave new connections in the backlog while the server is full
+			if (handshake_pool_) {
+				bool is_waiting = handshake_pool_->wait([self]() {
+					boost::asio::post(self->ioc_, [self]() { self->do_accept(); });
+				});
+				if (is_waiting) {
+					return;
+				}
+			}
+			if (admission_) {
+				auto delay = admission_->accept_delay();
+				if (delay == AdmissionControl::wait_for_release) {
+					bool is_waiting = admission_->wait([self]() {
+						boost::asio::post(self->ioc_, [self]() { self->do_accept(); });
+					});
+					if (is_waiting) {
+						return;
+					}
+				}
+				else if (delay.count() > 0) {
+					pause_timer_.expires_after(delay);
+					pause_timer_.async_wait([self](boost::system::error_code ec) {
+						if (!ec) {
+							self->do_accept();
+						}
+					});
+					return;
+				}
+			}
+
+			boost::asio::io_context& ioc = next_context();
+			if (use_strand_) {
+				// The new connection gets its own strand
+				acceptor_->async_accept(
+					boost::asio::make_strand(ioc),
+					boost::beast::bind_front_handler(
+						&Listener::on_accept,
+						self, std::ref(ioc)));
+			}
+			else {
+				acceptor_->async_accept(
+					ioc,
+					boost::beast::bind_front_handler(
+						&Listener::on_accept,
+						self, std::ref(ioc)));
+			}
 		}
 
-		void on_accept(boost::beast::error_code ec, boost::asio::ip::tcp::socket socket)
+		boost::asio::io_context& next_context() {
+			if (worker_contexts_.empty()) {
+				return ioc_;
+			}
+			return *worker_contexts_[next_worker_++ % worker_contexts_.size()];
+		}
+
+		void on_accept(boost::asio::io_context& ioc, boost::beast::error_code ec, boost::asio::ip::tcp::socket socket)
 		{
 			if (ec) {
 				exception_log("on_accept", ec);
@@ -133,19 +389,77 @@ namespace websocket {
 			}
 			else {
 				log_debug("Client connected!");
-				// Create the session and run it
-				auto session = std::make_shared<server_session_type>(std::move(socket), *ssl_context_, ioc_);
-				if (!session) {
-					return;
+				std::shared_ptr<AdmissionControl::ticket> ticket;
+				if (admission_) {
+					boost::system::error_code endpoint_ec;
+					auto remote = socket.remote_endpoint(endpoint_ec);
+					ticket = endpoint_ec ? nullptr : admission_->admit(remote.address());
+					if (!ticket) {
+						// Shed the connection, existing sessions keep their latency
+						socket.close(endpoint_ec);
+						do_accept();
+						return;
+					}
+				}
+
+				boost::system::error_code option_ec;
+				set_connection_options(socket, socket_options_, option_ec);
+				if (option_ec) {
+					exception_log("set_option", option_ec);
+				}
+
+				if (&ioc == &ioc_) {
+					start_session(ioc, std::move(socket), std::move(ticket));
+				}
+				else {
+					// Set the session up on the thread that will own it
+					auto self = Listener<server_session_type, base_session_type>::shared_from_this();
+					boost::asio::post(ioc,
+						[self, &ioc, socket = std::move(socket), ticket = std::move(ticket)]() mutable {
+						self->start_session(ioc, std::move(socket), std::move(ticket));
+					});
 				}
-				session->set_channel(channel_);
-				session->run(accepted_handler_);
 			}
 
 			// Accept another connection
 			do_accept();
 		}
 
+		void start_session(boost::asio::io_context& ioc, boost::asio::ip::tcp::socket&& socket,
+			std::shared_ptr<AdmissionControl::ticket>&& ticket)
+		{
+			// Create the session and run it
+			auto context = std::atomic_load(&ssl_context_);
+			auto session = std::make_shared<server_session_type>(std::move(socket), *context, ioc);
+			if (!session) {
+				return;
+			}
+			session->set_ssl_context(std::move(context));
+			session->set_channel(channel_);
+			session->set_write_batching(write_batching_, max_batch_bytes_);
+			session->set_write_queue_limits(write_limits_);
+			session->set_watermark_handler(watermark_handler_);
+			session->set_idle_timeout(idle_timeout_, idle_wheel_);
+			session->set_ping_interval(ping_interval_);
+			session->set_handshake_metrics(handshake_metrics_);
+			session->set_handshake_pool(handshake_pool_);
+			session->set_ktls(ktls_);
+			session->set_compression(compression_, compression_metrics_);
+			if (!ticket) {
+				session->run(accepted_handler_);
+				return;
+			}
+
+			// The handshake slot is freed on completion, or with the session
+			session->set_admission_ticket(ticket);
+			session->run([ticket, handler = accepted_handler_](std::shared_ptr<base_session_type> session) {
+				ticket->handshake_completed();
+				if (handler) {
+					handler(session);
+				}
+			});
+		}
+
 	};
 		
 	/*
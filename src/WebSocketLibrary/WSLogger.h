@@ -0,0 +1,582 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include <chrono>
+#include <ctime>
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <sstream>
+#include <thread>
+#include <fstream>
+
+#include <filesystem>
+#include <system_error>
+
+#if defined(WIN32) || defined(WIN64)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#endif
+
+#ifndef _CRT_SECURE_NO_WARNINGS
+#define  _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include "WSClock.h"
+
+namespace websocket {
+	// Filesystem
+#if defined(WIN32) || defined(WIN64)
+	static std::wstring GetCurrentPath() {
+		wchar_t buffer[MAX_PATH];
+		size_t path_len = GetModuleFileNameW(NULL, buffer, MAX_PATH);
+		if (path_len== 0) {
+			return L"";
+		}
+		std::wstring ws(buffer, path_len);
+		if (auto pos = ws.rfind(L"\\")) {
+			ws = ws.substr(0, pos + 1);
+		}
+		return ws;
+	}
+
+	static bool IsDirectoryExists(const std::wstring& path) {
+		return std::filesystem::exists(path);
+	}
+
+	static bool CreateDirectory(const std::wstring& path) {
+		if (IsDirectoryExists(path)) {
+			return true;
+		}
+
+		std::error_code ec;
+		if (std::filesystem::create_directory(path, ec) && ec) {
+			return true;
+		}
+
+		if (ec) {
+			std::cout << "Create director failed, error=" << ec.message() << std::endl;
+		}
+
+		return false;
+	}
+
+	static std::wstring GetLogFilePath(bool is_debug = false) {
+		// Create log folder and file
+		auto path = GetCurrentPath();
+		path += is_debug ? L"\\debug_log\\" : L"\\log\\";
+
+		if (IsDirectoryExists(path) || (!is_debug && CreateDirectory(path))) {
+			return path + L"WebSocket.log";
+		}
+		else {
+			return L"";
+		}
+	}
+
+#else
+	static std::string GetCurrentPath() {
+		return std::filesystem::current_path().string();
+	}
+
+	static bool IsDirectoryExists(const std::string& path) {
+		return std::filesystem::exists(path);
+	}
+
+	static bool CreateDirectory(const std::string& path) {
+		if (IsDirectoryExists(path)) {
+			return true;
+		}
+
+		std::error_code ec;
+		if (std::filesystem::create_directory(path, ec) && ec) {
+			return true;
+		}
+
+		if (ec) {
+			std::cout << "Create director failed, error=" << ec.message() << std::endl;
+		}
+
+		return false;
+	}
+
+	static std::string GetLogFilePath(bool is_debug = false) {
+		// Create log folder and file
+		auto path = GetCurrentPath();
+		path += is_debug ? "\\debug_log\\" : "\\log\\";
+
+		if (IsDirectoryExists(path) || (!is_debug && CreateDirectory(path))) {
+			return path + "WebSocket.log";
+		}
+		else {
+			return "";
+		}
+	}
+#endif
+
+	// Time 
+	static std::string get_now() {
+		return CoarseClock::instance().timestamp();
+	}
+
+	// Write the cached timestamp without allocating
+	static void write_now(std::ostream& os) {
+		char text[CoarseClock::max_timestamp];
+		os.write(text, CoarseClock::instance().timestamp(text, sizeof(text)));
+	}
+
+	static uint64_t get_now_epoch() {
+		return CoarseClock::instance().epoch_seconds();
+	}
+
+	// Severity of a log statement
+	enum class log_level : int {
+		debug,
+		info,
+		error,
+		off
+	};
+
+	// Statements below this level compile to nothing, 0 keeps debug logging.
+	// Release configurations define WS_MIN_LOG_LEVEL=1.
+#ifndef WS_MIN_LOG_LEVEL
+#define WS_MIN_LOG_LEVEL 0
+#endif
+	constexpr log_level min_log_level = static_cast<log_level>(WS_MIN_LOG_LEVEL);
+
+	// Threshold checked at run time, shared by every translation unit
+	class log_threshold {
+	public:
+		static std::atomic<int>& value() {
+			static std::atomic<int> threshold(static_cast<int>(min_log_level));
+			return threshold;
+		}
+	};
+
+	// Levels below min_log_level cannot be enabled again at run time
+	static void set_log_level(log_level level) {
+		log_threshold::value().store(static_cast<int>(level), std::memory_order_relaxed);
+	}
+
+	static log_level get_log_level() {
+		return static_cast<log_level>(log_threshold::value().load(std::memory_order_relaxed));
+	}
+
+	// Checked before any argument is formatted
+	template<log_level Level>
+	bool is_log_enabled() {
+		if constexpr (Level < min_log_level) {
+			return false;
+		}
+		else {
+			return static_cast<int>(Level) >= log_threshold::value().load(std::memory_order_relaxed);
+		}
+	}
+
+	// Destination of a log line
+	enum class log_target : uint32_t {
+		info,	// console and log file
+		debug,	// console and debug log file, if its folder exists
+		error	// error console and log file
+	};
+
+	// Single producer / single consumer byte ring holding log records.
+	// Each record is a header followed by the line, and may wrap around.
+	class LogRing {
+		struct record_header {
+			uint32_t length;
+			log_target target;
+		};
+
+		std::unique_ptr<char[]> buffer_;
+		const size_t capacity_;
+
+		alignas(64) std::atomic<size_t> head_;	// consumer position
+		alignas(64) std::atomic<size_t> tail_;	// producer position
+		std::atomic<bool> closed_;
+	public:
+		// capacity must be a power of two
+		explicit LogRing(size_t capacity)
+			: buffer_(new char[capacity])
+			, capacity_(capacity)
+			, head_(0)
+			, tail_(0)
+			, closed_(false) {
+		}
+
+		size_t max_record() const {
+			return capacity_ / 4;
+		}
+
+		// Producer only
+		bool try_write(log_target target, const char* data, size_t len) {
+			record_header header{ static_cast<uint32_t>(len), target };
+			size_t tail = tail_.load(std::memory_order_relaxed);
+			size_t head = head_.load(std::memory_order_acquire);
+			if (capacity_ - (tail - head) < sizeof(header) + len) {
+				return false;
+			}
+			copy_in(tail, reinterpret_cast<const char*>(&header), sizeof(header));
+			copy_in(tail + sizeof(header), data, len);
+			tail_.store(tail + sizeof(header) + len, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer only, invoke f(target, data, len) for every record,
+		// a wrapped record is passed as two consecutive parts.
+		template<typename F>
+		size_t drain(F f) {
+			size_t head = head_.load(std::memory_order_relaxed);
+			size_t tail = tail_.load(std::memory_order_acquire);
+			size_t count = 0;
+			while (head != tail) {
+				record_header header;
+				copy_out(head, reinterpret_cast<char*>(&header), sizeof(header));
+				size_t begin = (head + sizeof(header)) & (capacity_ - 1);
+				size_t first = std::min<size_t>(header.length, capacity_ - begin);
+				f(header.target, buffer_.get() + begin, first);
+				if (first < header.length) {
+					f(header.target, buffer_.get(), header.length - first);
+				}
+				head += sizeof(header) + header.length;
+				++count;
+			}
+			head_.store(head, std::memory_order_release);
+			return count;
+		}
+
+		bool empty() const {
+			return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+		}
+
+		void close() {
+			closed_ = true;
+		}
+
+		bool is_closed() const {
+			return closed_;
+		}
+
+	private:
+		void copy_in(size_t pos, const char* data, size_t len) {
+			size_t begin = pos & (capacity_ - 1);
+			size_t first = (std::min)(len, capacity_ - begin);
+			std::memcpy(buffer_.get() + begin, data, first);
+			std::memcpy(buffer_.get(), data + first, len - first);
+		}
+
+		void copy_out(size_t pos, char* data, size_t len) const {
+			size_t begin = pos & (capacity_ - 1);
+			size_t first = (std::min)(len, capacity_ - begin);
+			std::memcpy(data, buffer_.get() + begin, first);
+			std::memcpy(data + first, buffer_.get(), len - first);
+		}
+	};
+
+	// Logger whose callers only copy the line into a ring owned by their
+	// thread. A background thread drains every ring, and batches the lines
+	// to the console and to log files that stay open.
+	class AsyncLogger {
+		struct state {
+			std::mutex mutex_;
+			std::condition_variable cv_;
+			std::vector<std::shared_ptr<LogRing>> rings_;
+			std::atomic<bool> stop_;
+			std::atomic<uint64_t> dropped_;
+			std::atomic<uint64_t> written_;
+			std::atomic<uint64_t> drained_;
+			state() : stop_(false), dropped_(0), written_(0), drained_(0) {}
+		};
+
+		// Closes the ring of an exiting thread, the logger frees it once drained
+		struct ring_owner {
+			std::shared_ptr<LogRing> ring;
+			~ring_owner() {
+				if (ring) {
+					ring->close();
+				}
+			}
+		};
+
+		std::shared_ptr<state> state_;
+		std::thread thread_;
+		size_t ring_capacity_;
+
+	public:
+		static const size_t default_ring_capacity = 1 << 20;
+
+		explicit AsyncLogger(size_t ring_capacity = default_ring_capacity)
+			: state_(std::make_shared<state>())
+			, ring_capacity_(ring_capacity)
+		{
+			thread_ = std::thread([s = state_]() { run(s); });
+		}
+
+		~AsyncLogger() {
+			// Drain what is left, but never block process exit for long
+			flush(std::chrono::milliseconds(500));
+			state_->stop_ = true;
+			state_->cv_.notify_one();
+			if (thread_.joinable()) {
+				thread_.detach();
+			}
+		}
+
+		static AsyncLogger& instance() {
+			static AsyncLogger logger;
+			return logger;
+		}
+
+		void write(log_target target, std::string_view line) {
+			LogRing& ring = local_ring();
+			if (line.size() > ring.max_record()) {
+				line = line.substr(0, ring.max_record());
+			}
+
+			// Give the writer a short chance to catch up before dropping
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+			while (!ring.try_write(target, line.data(), line.size())) {
+				if (std::chrono::steady_clock::now() > deadline) {
+					state_->dropped_.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+				state_->cv_.notify_one();
+				std::this_thread::yield();
+			}
+			state_->written_.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// Wait until everything written so far reached the files
+		bool flush(std::chrono::milliseconds timeout = std::chrono::milliseconds(1000)) {
+			uint64_t target = state_->written_.load();
+			auto deadline = std::chrono::steady_clock::now() + timeout;
+			state_->cv_.notify_one();
+			while (state_->drained_.load() < target) {
+				if (std::chrono::steady_clock::now() > deadline) {
+					return false;
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			return true;
+		}
+
+		uint64_t dropped() const {
+			return state_->dropped_;
+		}
+
+	private:
+		LogRing& local_ring() {
+			thread_local ring_owner owner;
+			if (!owner.ring) {
+				owner.ring = std::make_shared<LogRing>(ring_capacity_);
+				std::lock_guard<std::mutex> guard(state_->mutex_);
+				state_->rings_.emplace_back(owner.ring);
+			}
+			return *owner.ring;
+		}
+
+		static void run(std::shared_ptr<state> s) {
+			std::string lines[3];
+			std::ofstream log_file;
+			std::ofstream debug_file;
+			auto last_open = std::chrono::steady_clock::time_point();
+			std::vector<std::shared_ptr<LogRing>> rings;
+			uint64_t reported_dropped = 0;
+
+			for (;;) {
+				bool is_stopping = s->stop_;
+				{
+					std::lock_guard<std::mutex> guard(s->mutex_);
+					// Forget rings of exited threads once they are empty
+					auto itor = s->rings_.begin();
+					while (itor != s->rings_.end()) {
+						if ((*itor)->is_closed() && (*itor)->empty()) {
+							itor = s->rings_.erase(itor);
+						}
+						else {
+							++itor;
+						}
+					}
+					rings = s->rings_;
+				}
+
+				size_t count = 0;
+				for (auto& ring : rings) {
+					count += ring->drain([&](log_target target, const char* data, size_t len) {
+						lines[static_cast<size_t>(target)].append(data, len);
+					});
+				}
+
+				uint64_t dropped = s->dropped_;
+				if (dropped != reported_dropped) {
+					lines[static_cast<size_t>(log_target::error)] += get_now() +
+						std::to_string(dropped - reported_dropped) + " log lines dropped\n";
+					reported_dropped = dropped;
+				}
+
+				// The debug log is enabled by creating its folder, look again now and then
+				auto now = std::chrono::steady_clock::now();
+				if ((!log_file.is_open() || !debug_file.is_open()) && now - last_open > std::chrono::seconds(5)) {
+					last_open = now;
+					open_file(log_file, false);
+					open_file(debug_file, true);
+				}
+
+				auto& info = lines[static_cast<size_t>(log_target::info)];
+				auto& debug = lines[static_cast<size_t>(log_target::debug)];
+				auto& error = lines[static_cast<size_t>(log_target::error)];
+				if (!info.empty()) {
+					std::fwrite(info.data(), 1, info.size(), stdout);
+					log_file.write(info.data(), info.size());
+				}
+				if (!error.empty()) {
+					std::fwrite(error.data(), 1, error.size(), stderr);
+					log_file.write(error.data(), error.size());
+				}
+				if (!debug.empty()) {
+					std::fwrite(debug.data(), 1, debug.size(), stdout);
+					debug_file.write(debug.data(), debug.size());
+				}
+				if (count != 0) {
+					std::fflush(stdout);
+					log_file.flush();
+					debug_file.flush();
+					for (auto& line : lines) {
+						line.clear();
+					}
+					s->drained_.fetch_add(count);
+					continue;
+				}
+
+				if (is_stopping) {
+					break;
+				}
+
+				std::unique_lock<std::mutex> lock(s->mutex_);
+				s->cv_.wait_for(lock, std::chrono::milliseconds(20));
+			}
+		}
+
+		static void open_file(std::ofstream& file, bool is_debug) {
+			if (file.is_open()) {
+				return;
+			}
+			auto path = GetLogFilePath(is_debug);
+			if (!path.empty()) {
+				file.open(std::filesystem::path(path), std::ios::binary | std::ios::app);
+			}
+		}
+	};
+
+	static void writeLog(const std::string& log, bool is_debug = false) {
+		if (is_debug ? !is_log_enabled<log_level::debug>() : !is_log_enabled<log_level::info>()) {
+			return;
+		}
+		AsyncLogger::instance().write(is_debug ? log_target::debug : log_target::info, log);
+	}
+
+	// Logger
+	template<typename T>
+	void exception_log(char const* category, const T& ec)
+	{
+		if (!is_log_enabled<log_level::error>()) {
+			return;
+		}
+
+		std::stringstream ss;
+		write_now(ss);
+		ss << category << ": " << ec.message() << std::endl;
+
+		AsyncLogger::instance().write(log_target::error, ss.str());
+	}
+
+	static void log(std::string_view content) {
+		if (!is_log_enabled<log_level::info>()) {
+			return;
+		}
+
+		std::stringstream ss;
+		write_now(ss);
+		ss << content << std::endl;
+
+		AsyncLogger::instance().write(log_target::info, ss.str());
+	}
+
+	static void log_debug(std::string_view content) {
+		if (!is_log_enabled<log_level::debug>()) {
+			return;
+		}
+
+		std::stringstream ss;
+		write_now(ss);
+		ss << content << std::endl;
+
+		AsyncLogger::instance().write(log_target::debug, ss.str());
+	}
+	/*
+	// Variadic functions
+	void log(const char* fmt, ...) {
+		char buf[1024];
+		va_list args;
+		va_start(args, fmt);
+		vsnprintf(buf, 1024, fmt, args);
+		va_end(args);
+
+		log(std::string(buf, 1024));
+	}
+	*/
+	static void templateLogImpl(std::stringstream& os, const char* format)
+	{
+		os << format;
+	}
+
+	// '%' followed by one character is replaced by the next argument
+	template<typename T, typename... Targs>
+	static void templateLogImpl(std::stringstream& os, const char* fmt, const T& value, const Targs&... Fargs) {
+		for (; *fmt != '\0'; fmt++) {
+			if (*fmt == '%') {
+				os << value;
+				templateLogImpl(os, fmt[1] != '\0' ? fmt + 2 : fmt + 1, Fargs...);
+				return;
+			}
+			os << *fmt;
+		}
+	}
+	// Wrapper of Parameter pack template
+	// Parameter pack template, arguments are only formatted when the level is enabled
+	template<typename T, typename... Targs>
+	void log(const char* fmt, const T& value, const Targs&... Fargs)
+	{
+		if (!is_log_enabled<log_level::info>()) {
+			return;
+		}
+
+		std::stringstream ss;
+		templateLogImpl(ss, fmt, value, Fargs...);
+
+		log(ss.str());
+	}
+
+	template<typename T, typename... Targs>
+	void log_debug(const char* fmt, const T& value, const Targs&... Fargs)
+	{
+		if (!is_log_enabled<log_level::debug>()) {
+			return;
+		}
+
+		std::stringstream ss;
+		templateLogImpl(ss, fmt, value, Fargs...);
+
+		log_debug(ss.str());
+	}
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/core/span.hpp>
+
+namespace websocket {
+	// Immutable payload, built once and shared by every session it is sent to
+	using SharedMessage = std::shared_ptr<const std::string>;
+
+	static SharedMessage make_shared_message(std::string&& data) {
+		return std::make_shared<const std::string>(std::move(data));
+	}
+
+	static SharedMessage make_shared_message(const std::string& data) {
+		return std::make_shared<const std::string>(data);
+	}
+
+	// Opcode of the data frames a message is sent with
+	enum class frame_type {
+		text,
+		binary
+	};
+
+	// Keeps caller owned memory alive while it is referenced by write queues,
+	// release is invoked once the last queue is done with it.
+	static std::shared_ptr<void> make_release_hook(std::function<void()>&& release) {
+		return std::shared_ptr<void>(static_cast<void*>(nullptr),
+			[release = std::move(release)](void*) {
+			if (release) {
+				release();
+			}
+		});
+	}
+
+	// Element of the session write queue. Owns a private copy of the
+	// payload, references a shared immutable one, or views memory owned
+	// by the caller whose lifetime is tied to holder.
+	class write_message {
+		std::string data_;
+		SharedMessage shared_;
+
+		std::vector<boost::asio::const_buffer> views_;
+		std::shared_ptr<void> holder_;
+		bool is_view_;
+
+		mutable boost::asio::const_buffer single_;
+		std::size_t size_;
+		frame_type type_;
+	public:
+		write_message()
+			: is_view_(false)
+			, size_(0)
+			, type_(frame_type::text) {}
+
+		write_message(const std::string& data, frame_type type = frame_type::text)
+			: data_(data)
+			, is_view_(false)
+			, size_(data_.size())
+			, type_(type) {}
+
+		write_message(std::string&& data, frame_type type = frame_type::text)
+			: data_(std::move(data))
+			, is_view_(false)
+			, size_(data_.size())
+			, type_(type) {}
+
+		write_message(SharedMessage shared, frame_type type = frame_type::text)
+			: shared_(std::move(shared))
+			, is_view_(false)
+			, size_(shared_ ? shared_->size() : 0)
+			, type_(type) {}
+
+		// Non-owning view of a contiguous buffer
+		write_message(boost::asio::const_buffer view, std::shared_ptr<void> holder, frame_type type)
+			: holder_(std::move(holder))
+			, is_view_(true)
+			, single_(view)
+			, size_(view.size())
+			, type_(type) {}
+
+		// Non-owning view of a buffer sequence, only the descriptors are copied
+		template<typename ConstBufferSequence>
+		write_message(const ConstBufferSequence& buffers, std::shared_ptr<void> holder, frame_type type)
+			: views_(boost::asio::buffer_sequence_begin(buffers), boost::asio::buffer_sequence_end(buffers))
+			, holder_(std::move(holder))
+			, is_view_(true)
+			, size_(boost::asio::buffer_size(buffers))
+			, type_(type) {}
+
+		// Buffer sequence valid as long as this message is not moved
+		boost::beast::span<const boost::asio::const_buffer> buffers() const {
+			if (!views_.empty()) {
+				return { views_.data(), views_.size() };
+			}
+			if (!is_view_) {
+				single_ = shared_ ? boost::asio::buffer(*shared_) : boost::asio::buffer(data_);
+			}
+			return { &single_, 1 };
+		}
+
+		std::size_t size() const {
+			return size_;
+		}
+
+		bool is_shared() const {
+			return shared_ != nullptr;
+		}
+
+		bool is_binary() const {
+			return type_ == frame_type::binary;
+		}
+	};
+}
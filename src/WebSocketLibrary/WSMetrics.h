@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+namespace websocket {
+	// Monotonic count read by monitoring, never used for synchronization
+	class Counter {
+		std::atomic<uint64_t> value_;
+	public:
+		Counter() : value_(0) {}
+
+		void add(uint64_t n = 1) {
+			value_.fetch_add(n, std::memory_order_relaxed);
+		}
+
+		uint64_t value() const {
+			return value_.load(std::memory_order_relaxed);
+		}
+	};
+
+	// Current level of something, such as a queue depth
+	class Gauge {
+		std::atomic<int64_t> value_;
+	public:
+		Gauge() : value_(0) {}
+
+		void add(int64_t n = 1) {
+			value_.fetch_add(n, std::memory_order_relaxed);
+		}
+
+		void sub(int64_t n = 1) {
+			value_.fetch_sub(n, std::memory_order_relaxed);
+		}
+
+		int64_t value() const {
+			return value_.load(std::memory_order_relaxed);
+		}
+	};
+
+	// TLS handshakes of accepted sessions
+	struct handshake_metrics {
+		Counter full;		// negotiated a new session
+		Counter resumed;	// from the session cache or a ticket
+		Counter failed;
+		Counter ktls_send;		// records sent by the kernel
+		Counter ktls_receive;	// records received by the kernel too
+		Counter ktls_fallback;	// kTLS requested but not possible
+	};
+
+	// Messages sent by sessions that negotiated permessage-deflate. The
+	// ratio is payload_bytes / wire_bytes.
+	struct compression_metrics {
+		Counter messages;		// sent compressed
+		Counter payload_bytes;	// of compressed messages
+		Counter wire_bytes;		// their frames as written
+		Counter cpu_ns;			// thread CPU time to deflate and frame them
+	};
+
+	// Jobs handed to a worker pool. The mean wait is wait_ns / jobs.
+	struct worker_metrics {
+		Gauge queued;			// waiting for a worker
+		Counter jobs;			// run by a worker
+		Counter wait_ns;		// from queued to started on a worker
+		Counter inline_runs;	// run by the caller, the queue was full
+	};
+}
@@ -0,0 +1,318 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace websocket {
+	// Unbounded lock-free multi-producer / single-consumer queue.
+	//
+	// Elements live in fixed size segments linked in a chain, so a push
+	// claims a slot with one fetch_add and allocates only once per segment.
+	// push() may be called from any thread, every other member except
+	// size() and empty() must be called from the single consumer.
+	//
+	// Retired segments are reclaimed once no producer that could still
+	// reference them is active, tracked by two alternating epoch counters.
+	template<typename T, std::size_t SegmentSize = 32>
+	class MPSCQueue {
+		static_assert(SegmentSize > 0, "SegmentSize must not be zero");
+
+		struct slot {
+			std::atomic<bool> ready;
+			typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+			T* get() {
+				return reinterpret_cast<T*>(&storage);
+			}
+		};
+
+		struct segment {
+			std::atomic<segment*> next;
+			std::atomic<std::size_t> claimed;
+			segment* retired_next;
+			slot slots[SegmentSize];
+
+			segment() {
+				reset();
+				for (auto& s : slots) {
+					s.ready.store(false, std::memory_order_relaxed);
+				}
+			}
+
+			void reset() {
+				next.store(nullptr, std::memory_order_relaxed);
+				claimed.store(0, std::memory_order_relaxed);
+				retired_next = nullptr;
+			}
+		};
+
+		// Registers an active producer in the current epoch
+		class producer_guard {
+			MPSCQueue& queue_;
+			unsigned epoch_;
+		public:
+			explicit producer_guard(MPSCQueue& queue)
+				: queue_(queue) {
+				for (;;) {
+					epoch_ = queue_.epoch_.load();
+					queue_.active_[epoch_].fetch_add(1);
+					if (queue_.epoch_.load() == epoch_) {
+						break;
+					}
+					queue_.active_[epoch_].fetch_sub(1);
+				}
+			}
+
+			~producer_guard() {
+				queue_.active_[epoch_].fetch_sub(1, std::memory_order_release);
+			}
+		};
+
+		// Producer side
+		alignas(64) std::atomic<segment*> tail_;
+		std::atomic<std::size_t> size_;
+		std::atomic<unsigned> epoch_;
+		std::atomic<std::size_t> active_[2];
+		std::atomic<segment*> spare_;
+
+		// Consumer side
+		alignas(64) segment* head_;
+		std::size_t head_index_;
+		segment* retired_;
+		segment* reclaiming_;
+		unsigned reclaim_epoch_;
+
+	private:
+		MPSCQueue(const MPSCQueue&) = delete;
+		MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+	public:
+		MPSCQueue()
+			: size_(0)
+			, epoch_(0)
+			, spare_(nullptr)
+			, head_index_(0)
+			, retired_(nullptr)
+			, reclaiming_(nullptr)
+			, reclaim_epoch_(0)
+		{
+			active_[0].store(0);
+			active_[1].store(0);
+			head_ = new segment();
+			tail_.store(head_);
+		}
+
+		virtual ~MPSCQueue() {
+			consume_all();
+
+			segment* seg = head_;
+			while (seg) {
+				segment* next = seg->next.load(std::memory_order_relaxed);
+				delete seg;
+				seg = next;
+			}
+			free_list(retired_);
+			free_list(reclaiming_);
+			delete spare_.load();
+		}
+
+		void push(const T& obj) {
+			emplace(obj);
+		}
+
+		void push(T&& obj) {
+			emplace(std::move(obj));
+		}
+
+		template<typename... Args>
+		void emplace(Args&&... args) {
+			producer_guard guard(*this);
+
+			// Counted before publishing so empty() never misses a pending push
+			size_.fetch_add(1, std::memory_order_relaxed);
+
+			segment* seg = tail_.load(std::memory_order_acquire);
+			for (;;) {
+				std::size_t index = seg->claimed.fetch_add(1, std::memory_order_acq_rel);
+				if (index < SegmentSize) {
+					slot& s = seg->slots[index];
+					new (s.get()) T(std::forward<Args>(args)...);
+					s.ready.store(true, std::memory_order_release);
+					return;
+				}
+
+				// Segment is full, link a new one or follow the one linked by others
+				segment* next = seg->next.load(std::memory_order_acquire);
+				if (!next) {
+					segment* fresh = acquire_segment();
+					if (seg->next.compare_exchange_strong(next, fresh, std::memory_order_acq_rel)) {
+						next = fresh;
+					}
+					else {
+						release_segment(fresh);
+					}
+				}
+				segment* expected = seg;
+				tail_.compare_exchange_strong(expected, next, std::memory_order_acq_rel);
+				seg = next;
+			}
+		}
+
+		// Consumer only. Return the front element or nullptr when the queue
+		// is empty or the next producer has not finished its push yet.
+		T* front() {
+			if (head_index_ == SegmentSize && !advance_head()) {
+				return nullptr;
+			}
+			slot& s = head_->slots[head_index_];
+			if (!s.ready.load(std::memory_order_acquire)) {
+				return nullptr;
+			}
+			return s.get();
+		}
+
+		// Consumer only, the front element must exist
+		void pop() {
+			slot& s = head_->slots[head_index_];
+			s.get()->~T();
+			s.ready.store(false, std::memory_order_relaxed);
+			++head_index_;
+			size_.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		bool try_pop(T& obj) {
+			T* item = front();
+			if (!item) {
+				return false;
+			}
+			obj = std::move(*item);
+			pop();
+			return true;
+		}
+
+		// Consumer only. Move elements into out while their accumulated
+		// measure stays within max_bytes, at least one if available.
+		template<typename Container, typename Measure>
+		size_t fetch_batch(Container& out, size_t max_bytes, Measure measure) {
+			size_t count = 0;
+			size_t bytes = 0;
+			while (T* item = front()) {
+				size_t next = measure(*item);
+				if (count != 0 && bytes + next > max_bytes) {
+					break;
+				}
+				bytes += next;
+				out.emplace_back(std::move(*item));
+				pop();
+				++count;
+			}
+			return count;
+		}
+
+		// Consumer only. Move elements into out as long as pred accepts them
+		template<typename Container, typename Pred>
+		size_t fetch_while(Container& out, Pred pred) {
+			size_t count = 0;
+			while (T* item = front()) {
+				if (!pred(*item)) {
+					break;
+				}
+				out.emplace_back(std::move(*item));
+				pop();
+				++count;
+			}
+			return count;
+		}
+
+		// Consumer only
+		void consume_all() {
+			while (front()) {
+				pop();
+			}
+		}
+
+		// Approximate when producers are active
+		size_t size() const {
+			return size_.load(std::memory_order_relaxed);
+		}
+
+		bool empty() const {
+			return size() == 0;
+		}
+
+	private:
+		bool advance_head() {
+			segment* next = head_->next.load(std::memory_order_acquire);
+			if (!next) {
+				return false;
+			}
+
+			// New producers must not start from the segment being retired
+			segment* expected = head_;
+			tail_.compare_exchange_strong(expected, next, std::memory_order_acq_rel);
+
+			head_->retired_next = retired_;
+			retired_ = head_;
+			head_ = next;
+			head_index_ = 0;
+
+			reclaim();
+			return true;
+		}
+
+		void reclaim() {
+			if (reclaiming_) {
+				if (active_[reclaim_epoch_].load() != 0) {
+					return;
+				}
+				release_list(reclaiming_);
+				reclaiming_ = nullptr;
+			}
+
+			if (retired_) {
+				// Producers entering from now on are counted in the other epoch
+				reclaiming_ = retired_;
+				retired_ = nullptr;
+				reclaim_epoch_ = epoch_.fetch_xor(1);
+				if (active_[reclaim_epoch_].load() == 0) {
+					release_list(reclaiming_);
+					reclaiming_ = nullptr;
+				}
+			}
+		}
+
+		segment* acquire_segment() {
+			segment* seg = spare_.exchange(nullptr);
+			if (seg) {
+				seg->reset();
+				return seg;
+			}
+			return new segment();
+		}
+
+		void release_segment(segment* seg) {
+			segment* expected = nullptr;
+			if (!spare_.compare_exchange_strong(expected, seg)) {
+				delete seg;
+			}
+		}
+
+		void release_list(segment* seg) {
+			while (seg) {
+				segment* next = seg->retired_next;
+				release_segment(seg);
+				seg = next;
+			}
+		}
+
+		static void free_list(segment* seg) {
+			while (seg) {
+				segment* next = seg->retired_next;
+				delete seg;
+				seg = next;
+			}
+		}
+	};
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "WSMessage.h"
+
+namespace websocket {
+
+	enum class replay_status {
+		// No resume asked, the session starts at the current sequence
+		started,
+		// Every message after the asked sequence was queued
+		resumed,
+		// The asked sequence was evicted or is unknown
+		snapshot_required
+	};
+
+	// One channel a joining session asks to receive, and what it missed
+	struct replay_point {
+		std::string channel;
+
+		// Last sequence the client received when resume is set, the last
+		// sequence of the channel once the point is replayed
+		bool resume = false;
+		std::uint64_t sequence = 0;
+
+		replay_status status = replay_status::started;
+		std::vector<write_message> missed;
+	};
+
+	// Bounded log of the last messages of one channel. Sequences start at 1
+	// and grow by one per message, the oldest is overwritten when full.
+	// Messages are shared with the sessions, so a retained message costs the
+	// entry only. Not thread safe, the owner of the channel locks it.
+	class ReplayLog {
+		struct entry {
+			std::uint64_t sequence;
+			write_message message;
+		};
+		std::vector<entry> ring_;
+		std::size_t capacity_;
+		std::uint64_t start_;	// sequence before the first message
+		std::uint64_t last_;
+
+	public:
+		// The first message gets sequence last + 1
+		explicit ReplayLog(std::size_t capacity, std::uint64_t last = 0)
+			: capacity_(std::max<std::size_t>(1, capacity))
+			, start_(last)
+			, last_(last) {
+			ring_.reserve(capacity_);
+		}
+
+		std::uint64_t append(const write_message& message) {
+			++last_;
+			if (ring_.size() < capacity_) {
+				ring_.push_back(entry{ last_, message });
+			}
+			else {
+				ring_[slot(last_)] = entry{ last_, message };
+			}
+			return last_;
+		}
+
+		std::uint64_t last_sequence() const {
+			return last_;
+		}
+
+		// Oldest sequence still held, last_sequence() + 1 when empty
+		std::uint64_t first_sequence() const {
+			return last_ - ring_.size() + 1;
+		}
+
+		// Copy the messages after sequence, false if some were evicted
+		bool collect(std::uint64_t sequence, std::vector<write_message>& missed) const {
+			if (sequence > last_ || sequence + 1 < first_sequence()) {
+				return false;
+			}
+			missed.reserve(missed.size() + static_cast<std::size_t>(last_ - sequence));
+			for (std::uint64_t next = sequence + 1; next <= last_; ++next) {
+				missed.push_back(ring_[slot(next)].message);
+			}
+			return true;
+		}
+
+		void replay(replay_point& point) const {
+			if (!point.resume) {
+				point.status = replay_status::started;
+			}
+			else if (collect(point.sequence, point.missed)) {
+				point.status = replay_status::resumed;
+			}
+			else {
+				point.missed.clear();
+				point.status = replay_status::snapshot_required;
+			}
+			point.sequence = last_;
+		}
+
+	private:
+		std::size_t slot(std::uint64_t sequence) const {
+			return static_cast<std::size_t>((sequence - start_ - 1) % capacity_);
+		}
+	};
+}
@@ -22,12 +22,15 @@ namespace websocket {
 				boost::beast::websocket::stream_base::timeout::suggested(
 					boost::beast::role_type::server));
 
-			// Set a decorator to change the Server of the handshake
+			// Set a decorator to change the Server of the handshake, it
+			// also sees whether permessage-deflate was accepted
+			offer_compression();
 			ws_.set_option(boost::beast::websocket::stream_base::decorator(
-				[](boost::beast::websocket::response_type& res) {
+				[this](boost::beast::websocket::response_type& res) {
 				res.set(boost::beast::http::field::server,
 					std::string(BOOST_BEAST_VERSION_STRING) +
 					" websocket-server-async");
+				on_compression_negotiated(res);
 			}));
 
 			// Accept the websocket handshake
@@ -40,21 +43,11 @@ namespace websocket {
 					return;
 				}
 
-				do_timer_work(std::bind(
-					&server_tcp_session::check_alive, this), 2);
+				start_keepalive();
 
 				handler(self);
 			});
 		}
-
-	private:
-		bool check_alive() {
-			if (get_now_epoch() - last_message_ >= 15) {
-				shutdown("time out");
-				return false;
-			}
-			return true;
-		}
 	};
 	
 	class server_ssl_session : public ssl_session {
@@ -77,11 +70,15 @@ namespace websocket {
 		}
 
 		void run(const OnConnectionCompleted<ssl_session>& handler) {
+			if (handshake_pool_) {
+				return run_on_pool(handler);
+			}
+
 			// Set the timeout.
 			boost::beast::get_lowest_layer(ws_).expires_after(std::chrono::seconds(30));
 
 			// Perform the SSL handshake
-			ws_.next_layer().async_handshake(
+			transport().async_handshake(
 				boost::asio::ssl::stream_base::server,
 				[this, self = shared_from_this(),
 				h = std::move(handler)]
@@ -91,10 +88,95 @@ namespace websocket {
 		}
 	
 	private:
+		// The SSL stream runs its handshake steps on the executor of the
+		// completion handler, so binding it to a pool strand moves the key
+		// operations off the io threads while the socket stays where it is.
+		// Only the pool strand touches the stream until the handshake ends,
+		// which is why the timeout is a pool timer instead of the tcp_stream one.
+		void run_on_pool(OnConnectionCompleted<ssl_session> handler) {
+			auto strand = handshake_pool_->make_strand();
+			auto slot = handshake_pool_->enter();
+			boost::asio::post(strand,
+				[this, self = shared_from_this(), strand,
+				slot = std::move(slot), h = std::move(handler)]() mutable {
+				auto timer = std::make_shared<boost::asio::steady_timer>(strand, std::chrono::seconds(30));
+				timer->async_wait(boost::asio::bind_executor(strand,
+					[this, self](boost::system::error_code ec) {
+					if (!ec) {
+						boost::beast::get_lowest_layer(ws_).cancel();
+					}
+				}));
+
+				transport().async_handshake(
+					boost::asio::ssl::stream_base::server,
+					boost::asio::bind_executor(strand,
+						[this, self, timer, slot = std::move(slot), h = std::move(h)]
+					(boost::beast::error_code ec) mutable {
+					timer->cancel();
+					slot.reset();
+
+					// Back to the session executor
+					boost::asio::post(ws_.get_executor(),
+						[this, self, ec, h = std::move(h)]() mutable {
+						on_handshake(ec, std::move(h));
+					});
+				}));
+			});
+		}
+
 		void on_handshake(boost::beast::error_code ec, OnConnectionCompleted<ssl_session>&& handler) {
-			if (ec)
+			if (ec) {
+				if (handshake_metrics_) {
+					handshake_metrics_->failed.add();
+				}
 				return exception_log("handshake", ec);
+			}
+
+			if (handshake_metrics_) {
+				if (SSL_session_reused(transport().native_handle())) {
+					handshake_metrics_->resumed.add();
+				}
+				else {
+					handshake_metrics_->full.add();
+				}
+			}
+
+			if (ktls_) {
+				transport().async_enable_ktls(
+					[this, self = shared_from_this(), h = std::move(handler)]
+				(boost::beast::error_code ec) mutable {
+					on_enable_ktls(ec, std::move(h));
+				});
+				return;
+			}
+
+			do_accept(std::move(handler));
+		}
+
+		void on_enable_ktls(boost::beast::error_code ec, OnConnectionCompleted<ssl_session>&& handler) {
+			if (ec) {
+				return exception_log("enable ktls", ec);
+			}
 
+			if (handshake_metrics_) {
+				switch (transport().ktls()) {
+				case ktls_mode::send_receive:
+					handshake_metrics_->ktls_receive.add();
+					handshake_metrics_->ktls_send.add();
+					break;
+				case ktls_mode::send:
+					handshake_metrics_->ktls_send.add();
+					break;
+				default:
+					handshake_metrics_->ktls_fallback.add();
+					break;
+				}
+			}
+
+			do_accept(std::move(handler));
+		}
+
+		void do_accept(OnConnectionCompleted<ssl_session>&& handler) {
 			// Turn off the timeout on the tcp_stream, because
 			// the websocket stream has its own timeout system.
 			boost::beast::get_lowest_layer(ws_).expires_never();
@@ -104,12 +186,15 @@ namespace websocket {
 				boost::beast::websocket::stream_base::timeout::suggested(
 					boost::beast::role_type::server));
 
-			// Set a decorator to change the Server of the handshake
+			// Set a decorator to change the Server of the handshake, it
+			// also sees whether permessage-deflate was accepted
+			offer_compression();
 			ws_.set_option(boost::beast::websocket::stream_base::decorator(
-				[](boost::beast::websocket::response_type& res) {
+				[this](boost::beast::websocket::response_type& res) {
 				res.set(boost::beast::http::field::server,
 					std::string(BOOST_BEAST_VERSION_STRING) +
 					" websocket-server-async-ssl");
+				on_compression_negotiated(res);
 			}));
 
 			// Accept the websocket handshake
@@ -127,19 +212,10 @@ namespace websocket {
 				return;
 			}
 
-			do_timer_work(std::bind(
-				&server_ssl_session::check_alive, this), 5);
+			start_keepalive();
 
 			handler(shared_from_this());
 		}
-
-		bool check_alive() {
-			if (get_now_epoch() - last_message_ >= 15) {
-				shutdown("time out");
-				return false;
-			}
-			return true;
-		}
 	};
 
 	/*
@@ -1,29 +1,121 @@
+#pragma once
 #include <boost/beast/core.hpp>
 #include <boost/beast/ssl/ssl_stream.hpp>
 #include <boost/beast/websocket.hpp>
 #include <boost/beast/websocket/ssl.hpp>
 #include <boost/asio.hpp>
 
+#include <atomic>
+#include <deque>
+#include <iterator>
+
 #include "WSUtility.h"
+#include "WSBatchStream.h"
+#include "WSCompression.h"
 #include "WSDefinition.h"
+#include "WSHandshakePool.h"
+#include "WSMessage.h"
+#include "WSMetrics.h"
+#include "WSQueue.h"
+#include "WSTimer.h"
+#include "WSTLSStream.h"
 
 namespace websocket {
 	template<typename socket_type>
 	class session_base : public std::enable_shared_from_this<session_base<socket_type>> {
 	protected:
+		// Context the stream was created with, kept while the listener may
+		// swap in a new one. Declared first to outlive the stream.
+		SSLContext ssl_context_;
+
 		boost::beast::websocket::stream<socket_type> ws_;
 
 		boost::asio::io_context& io_context_;
 		boost::asio::steady_timer timer_;
 
 		boost::beast::flat_buffer read_buffer_;
-		LockQueue<std::string> write_queue_;
+
+		// Set while a view handler runs, a read requested meanwhile waits
+		// until the buffer has been consumed. Only touched on the strand.
+		bool is_delivering_;
+		AsyncReadViewHandler<session_base> pending_view_handler_;
+
+		// Message waiting for write, with optional completion handler
+		struct pending_write {
+			write_message message;
+			AsyncWriteHandler<session_base> handler;
+		};
+		MPSCQueue<pending_write, 16> write_queue_;
+
+		// Messages drained from write_queue_, only touched on the strand
+		std::vector<pending_write> write_batch_;
+		std::size_t write_batch_index_;
+
+		// Messages kept by trim_write_queue, written before the queue.
+		// Only touched on the strand.
+		std::deque<pending_write> write_backlog_;
+
+		std::atomic<bool> is_writing_;
+		std::atomic<bool> is_trimming_;
+
+		// Set once a write failed, the stream is broken and sends are refused
+		std::atomic<bool> is_write_failed_;
+
+		// Drain as many queued messages as fit in max_batch_bytes_ per batch
+		bool write_batching_;
+		std::size_t max_batch_bytes_;
+
+		// Accounting of everything queued or being written
+		write_queue_limits write_limits_;
+		std::atomic<std::size_t> queued_bytes_;
+		std::atomic<std::size_t> queued_messages_;
+		std::atomic<bool> above_high_watermark_;
+		WatermarkHandler<session_base> watermark_handler_;
+
+		// State the watermark handler was last told, only touched on the strand
+		bool is_notified_above_;
 
 		// Channel using for broadcast read message
 		std::shared_ptr<Channel> channel_;
 
+		// Monotonic milliseconds of the last received message
 		uint64_t last_message_;
 
+		// Idle timeout, the session is closed when nothing was received for
+		// idle_timeout_. Zero disables it.
+		std::chrono::milliseconds idle_timeout_;
+		std::shared_ptr<TimingWheel> idle_wheel_;
+		TimingWheel::entry_ptr idle_entry_;
+
+		// Slots taken in the listener admission control, freed with the session
+		std::shared_ptr<void> admission_ticket_;
+
+		// Shared with the listener, counts the TLS handshake if any
+		std::shared_ptr<handshake_metrics> handshake_metrics_;
+
+		// Runs the TLS handshake if set, instead of the session io_context
+		std::shared_ptr<HandshakePool> handshake_pool_;
+
+		// Move the TLS record layer into the kernel after the handshake
+		bool ktls_;
+
+		// permessage-deflate offer, and the meter of the stream once negotiated
+		compression_options compression_;
+		std::shared_ptr<compression_metrics> compression_metrics_;
+		std::shared_ptr<write_meter> write_meter_;
+		uint64_t metered_bytes_;
+		uint64_t metered_cpu_ns_;
+
+		// Keepalive, a ping is sent after ping_interval_ without receiving
+		// anything. Zero disables it. Only touched on the strand.
+		std::chrono::milliseconds ping_interval_;
+		TimingWheel::entry_ptr ping_entry_;
+		bool is_pinging_;
+
+		// Monotonic milliseconds of the last ping sent, the polling timer
+		// pings once per interval from it. Only touched on the strand.
+		uint64_t last_ping_;
+
 	protected:
 		// Assign a accepted socket form listener
 		explicit session_base(boost::asio::ip::tcp::socket&& socket,
@@ -31,7 +123,25 @@ namespace websocket {
 			: ws_(std::move(socket))
 			, io_context_(ioc)
 			, timer_(ioc)
-			, last_message_(get_now_epoch())
+			, is_delivering_(false)
+			, write_batch_index_(0)
+			, is_writing_(false)
+			, is_trimming_(false)
+			, is_write_failed_(false)
+			, write_batching_(false)
+			, max_batch_bytes_(default_max_batch_bytes)
+			, queued_bytes_(0)
+			, queued_messages_(0)
+			, above_high_watermark_(false)
+			, is_notified_above_(false)
+			, last_message_(CoarseClock::instance().steady_ms())
+			, idle_timeout_(default_idle_timeout)
+			, ktls_(false)
+			, metered_bytes_(0)
+			, metered_cpu_ns_(0)
+			, ping_interval_(0)
+			, is_pinging_(false)
+			, last_ping_(0)
 		{
 		}
 
@@ -42,7 +152,25 @@ namespace websocket {
 			: ws_(std::move(socket), ctx)
 			, io_context_(ioc)
 			, timer_(ioc)
-			, last_message_(get_now_epoch())
+			, is_delivering_(false)
+			, write_batch_index_(0)
+			, is_writing_(false)
+			, is_trimming_(false)
+			, is_write_failed_(false)
+			, write_batching_(false)
+			, max_batch_bytes_(default_max_batch_bytes)
+			, queued_bytes_(0)
+			, queued_messages_(0)
+			, above_high_watermark_(false)
+			, is_notified_above_(false)
+			, last_message_(CoarseClock::instance().steady_ms())
+			, idle_timeout_(default_idle_timeout)
+			, ktls_(false)
+			, metered_bytes_(0)
+			, metered_cpu_ns_(0)
+			, ping_interval_(0)
+			, is_pinging_(false)
+			, last_ping_(0)
 		{
 		}
 
@@ -51,12 +179,36 @@ namespace websocket {
 			: ws_(boost::asio::make_strand(ioc))
 			, io_context_(ioc)
 			, timer_(ioc)
-			, last_message_(get_now_epoch())
+			, is_delivering_(false)
+			, write_batch_index_(0)
+			, is_writing_(false)
+			, is_trimming_(false)
+			, is_write_failed_(false)
+			, write_batching_(false)
+			, max_batch_bytes_(default_max_batch_bytes)
+			, queued_bytes_(0)
+			, queued_messages_(0)
+			, above_high_watermark_(false)
+			, is_notified_above_(false)
+			, last_message_(CoarseClock::instance().steady_ms())
+			, idle_timeout_(default_idle_timeout)
+			, ktls_(false)
+			, metered_bytes_(0)
+			, metered_cpu_ns_(0)
+			, ping_interval_(0)
+			, is_pinging_(false)
+			, last_ping_(0)
 		{
 		}
 
 		virtual ~session_base() {
 			timer_.cancel();
+			if (idle_entry_) {
+				idle_entry_->cancel();
+			}
+			if (ping_entry_) {
+				ping_entry_->cancel();
+			}
 			log_debug("Connection closed");
 		}
 
@@ -69,29 +221,45 @@ namespace websocket {
 			if (!ws_.is_open()) return;
 
 			boost::system::error_code ec;
-			get_lowest_layer(ws_).cancel();
+			boost::beast::get_lowest_layer(ws_).cancel();
 			ws_.close(boost::beast::websocket::close_reason(reason.c_str()), ec);
 			if (ec) {
 				exception_log("shutdown", ec);
 			}
 		}
 
-		void send(const std::string& data) {
-			bool is_writing = !write_queue_.empty();
-			write_queue_.push(data);
+		// Return false if the message was refused by the write queue limits
+		bool send(const std::string& data) {
+			return enqueue_write(pending_write{ data, nullptr });
+		}
 
-			if (!is_writing) {
-				do_write();
-			}
+		bool send(std::string&& data) {
+			return enqueue_write(pending_write{ std::move(data), nullptr });
 		}
 
-		void send(std::string&& data) {
-			bool is_writing = !write_queue_.empty();
-			write_queue_.push(std::move(data));
+		// The payload is referenced, not copied, so one message can be
+		// queued on any number of sessions.
+		bool send(SharedMessage data) {
+			return enqueue_write(pending_write{ std::move(data), nullptr });
+		}
 
-			if (!is_writing) {
-				do_write();
-			}
+		bool send(write_message&& message) {
+			return enqueue_write(pending_write{ std::move(message), nullptr });
+		}
+
+		bool send_binary(std::string&& data) {
+			return send(write_message(std::move(data), frame_type::binary));
+		}
+
+		bool send_binary(SharedMessage data) {
+			return send(write_message(std::move(data), frame_type::binary));
+		}
+
+		// Send memory owned by the caller without copying it. It must stay
+		// valid until holder is released, see make_release_hook.
+		template<typename ConstBufferSequence>
+		bool send_binary(const ConstBufferSequence& buffers, std::shared_ptr<void> holder) {
+			return send(write_message(buffers, std::move(holder), frame_type::binary));
 		}
 
 		void receive() {
@@ -102,19 +270,115 @@ namespace websocket {
 			channel_ = channel;
 		}
 
-		void send(std::string&& data, AsyncWriteHandler<session_base>&& handler) {
-			bool is_writing = !write_queue_.empty();
-			write_queue_.push(std::move(data));
+		// Context the session runs on
+		boost::asio::io_context& get_io_context() {
+			return io_context_;
+		}
+
+		// A refused message completes the handler with no_buffer_space
+		bool send(std::string&& data, AsyncWriteHandler<session_base>&& handler) {
+			return enqueue_write(pending_write{ std::move(data), std::move(handler) });
+		}
+
+		bool send(SharedMessage data, AsyncWriteHandler<session_base>&& handler) {
+			return enqueue_write(pending_write{ std::move(data), std::move(handler) });
+		}
+
+		// In batching mode every write drains all queued messages up to
+		// max_batch_bytes. Their frames are gathered below the websocket
+		// stream and the batch goes out as one socket write, its handlers
+		// complete once that write did.
+		void set_write_batching(bool enable, std::size_t max_batch_bytes = default_max_batch_bytes) {
+			write_batching_ = enable;
+			max_batch_bytes_ = std::max<std::size_t>(1, max_batch_bytes);
+		}
 
-			if (!is_writing) {
-				do_write(std::move(handler));
+		void set_write_queue_limits(const write_queue_limits& limits) {
+			write_limits_ = limits;
+			if (write_limits_.low_watermark > write_limits_.high_watermark) {
+				write_limits_.low_watermark = write_limits_.high_watermark;
 			}
 		}
 
+		// The handler runs on the session strand, never inside send
+		void set_watermark_handler(const WatermarkHandler<session_base>& handler) {
+			watermark_handler_ = handler;
+		}
+
+		std::size_t queued_bytes() const {
+			return queued_bytes_;
+		}
+
+		std::size_t queued_messages() const {
+			return queued_messages_;
+		}
+
 		void receive(AsyncReadHandler<session_base>&& handler) {
 			do_read(std::move(handler));
 		}
 
+		// Deliver messages as a view of the read buffer, without copying
+		// them into a std::string first.
+		void receive_view(AsyncReadViewHandler<session_base>&& handler) {
+			if (is_delivering_) {
+				pending_view_handler_ = std::move(handler);
+				return;
+			}
+			do_read_view(std::move(handler));
+		}
+
+		// Sessions of one io_context share the wheel, without one the
+		// session polls its own timer instead.
+		void set_idle_timeout(std::chrono::milliseconds timeout, std::shared_ptr<TimingWheel> wheel = nullptr) {
+			idle_timeout_ = timeout;
+			idle_wheel_ = std::move(wheel);
+		}
+
+		std::chrono::milliseconds idle_timeout() const {
+			return idle_timeout_;
+		}
+
+		// Send ping control frames once nothing was received for interval,
+		// must be set before the handshake completes
+		void set_ping_interval(std::chrono::milliseconds interval) {
+			ping_interval_ = interval;
+		}
+
+		std::chrono::milliseconds ping_interval() const {
+			return ping_interval_;
+		}
+
+		void set_admission_ticket(std::shared_ptr<void> ticket) {
+			admission_ticket_ = std::move(ticket);
+		}
+
+		void set_ssl_context(SSLContext context) {
+			ssl_context_ = std::move(context);
+		}
+
+		void set_handshake_metrics(std::shared_ptr<handshake_metrics> metrics) {
+			handshake_metrics_ = std::move(metrics);
+		}
+
+		void set_handshake_pool(std::shared_ptr<HandshakePool> pool) {
+			handshake_pool_ = std::move(pool);
+		}
+
+		void set_ktls(bool enable) {
+			ktls_ = enable;
+		}
+
+		// Offer permessage-deflate in the handshake, set before run
+		void set_compression(const compression_options& options, std::shared_ptr<compression_metrics> metrics) {
+			compression_ = options;
+			compression_metrics_ = std::move(metrics);
+		}
+
+		// Whether the handshake negotiated permessage-deflate
+		bool is_compressing() const {
+			return write_meter_ != nullptr;
+		}
+
 		template<typename T>
 		void do_timer_work(T&& handler, size_t time_interval) {
 			timer_.expires_from_now(std::chrono::seconds(time_interval));
@@ -131,6 +395,144 @@ namespace websocket {
 			});
 		}
 
+	protected:
+		// Layer below the meter that gathers the frames of a batch
+		typename socket_type::next_layer_type& batch_layer() {
+			return ws_.next_layer().next_layer();
+		}
+
+		// Stream the frames are written to, TCP or TLS
+		typename socket_type::next_layer_type::next_layer_type& transport() {
+			return batch_layer().next_layer();
+		}
+
+		// Before the websocket handshake
+		void offer_compression() {
+			if (compression_.enable) {
+				ws_.set_option(make_permessage_deflate(compression_));
+			}
+		}
+
+		// With the handshake response, starts metering compressed messages
+		template<typename Response>
+		void on_compression_negotiated(const Response& res) {
+			if (compression_.enable && compression_metrics_ && is_deflate_negotiated(res)) {
+				write_meter_ = std::make_shared<write_meter>();
+				ws_.next_layer().set_write_meter(write_meter_);
+			}
+		}
+
+		// Called on the strand once the websocket handshake completed.
+		// Any frame received, data, ping or pong, counts as activity, which
+		// requires a read to be outstanding.
+		void start_keepalive() {
+			ws_.control_callback(
+				[this](boost::beast::websocket::frame_type kind, boost::beast::string_view) {
+				if (kind != boost::beast::websocket::frame_type::close) {
+					touch();
+				}
+			});
+
+			if (idle_timeout_.count() <= 0 && ping_interval_.count() <= 0) {
+				return;
+			}
+
+			if (idle_wheel_) {
+				if (idle_timeout_.count() > 0) {
+					std::weak_ptr<session_base> weak = session_base<socket_type>::shared_from_this();
+					idle_entry_ = idle_wheel_->add(idle_timeout_, [weak]() {
+						if (auto self = weak.lock()) {
+							boost::asio::post(self->ws_.get_executor(), [self]() {
+								self->shutdown("time out");
+							});
+						}
+					});
+				}
+				schedule_ping();
+				return;
+			}
+
+			// Without a wheel the session polls its own timer
+			check_alive();
+		}
+
+		// Close the session once idle for idle_timeout_, ping once per
+		// ping_interval_, then sleep until the earlier of the two is due.
+		// Pongs are not seen without a read outstanding, so the ping
+		// interval counts from the last ping too. Called on the strand.
+		void check_alive() {
+			const uint64_t now = CoarseClock::instance().steady_ms();
+			auto idle = std::chrono::milliseconds(now - last_message_);
+			if (idle_timeout_.count() > 0 && idle >= idle_timeout_) {
+				shutdown("time out");
+				return;
+			}
+
+			auto next = idle_timeout_ - idle;
+			if (ping_interval_.count() > 0) {
+				auto quiet = std::chrono::milliseconds(now - (std::max)(last_message_, last_ping_));
+				if (quiet >= ping_interval_) {
+					do_ping();
+					quiet = std::chrono::milliseconds(0);
+				}
+				auto due = ping_interval_ - quiet;
+				next = idle_timeout_.count() > 0 ? (std::min)(next, due) : due;
+			}
+
+			timer_.expires_after((std::max)(next, std::chrono::milliseconds(1)));
+			timer_.async_wait(boost::asio::bind_executor(ws_.get_executor(),
+				[this](boost::system::error_code ec) {
+				if (!ec) {
+					check_alive();
+				}
+			}));
+		}
+
+		// The entry expires, and a ping is sent, only if nothing was received
+		// for a whole interval. Called on the strand.
+		void schedule_ping() {
+			if (!idle_wheel_ || ping_interval_.count() <= 0 || !ws_.is_open()) {
+				return;
+			}
+
+			std::weak_ptr<session_base> weak = session_base<socket_type>::shared_from_this();
+			ping_entry_ = idle_wheel_->add(ping_interval_, [weak]() {
+				if (auto self = weak.lock()) {
+					boost::asio::post(self->ws_.get_executor(), [self]() {
+						self->do_ping();
+						self->schedule_ping();
+					});
+				}
+			});
+		}
+
+		void do_ping() {
+			if (is_pinging_ || !ws_.is_open()) {
+				return;
+			}
+
+			is_pinging_ = true;
+			last_ping_ = CoarseClock::instance().steady_ms();
+			ws_.async_ping({},
+				[self = session_base<socket_type>::shared_from_this()](boost::beast::error_code ec) {
+				self->is_pinging_ = false;
+				if (ec && ec != boost::asio::error::operation_aborted) {
+					exception_log("ping", ec);
+				}
+			});
+		}
+
+		// Record that a message was received
+		void touch() {
+			last_message_ = CoarseClock::instance().steady_ms();
+			if (idle_entry_) {
+				idle_entry_->touch();
+			}
+			if (ping_entry_) {
+				ping_entry_->touch();
+			}
+		}
+
 	private:
 		void do_read() {
 			ws_.async_read(
@@ -142,15 +544,246 @@ namespace websocket {
 				});
 		}
 
+		bool is_over_limits(std::size_t bytes, std::size_t messages) const {
+			return (write_limits_.max_bytes != 0 && bytes > write_limits_.max_bytes) ||
+				(write_limits_.max_messages != 0 && messages > write_limits_.max_messages);
+		}
+
+		bool enqueue_write(pending_write&& pending) {
+			if (is_write_failed_) {
+				if (pending.handler) {
+					pending.handler(boost::asio::error::broken_pipe, 0,
+						session_base<socket_type>::shared_from_this());
+				}
+				return false;
+			}
+
+			const std::size_t size = pending.message.size();
+
+			// Reserve room first so concurrent producers see each other
+			std::size_t bytes = queued_bytes_.fetch_add(size) + size;
+			std::size_t messages = queued_messages_.fetch_add(1) + 1;
+
+			bool is_over = is_over_limits(bytes, messages);
+			if (is_over && !can_make_room()) {
+				queued_bytes_ -= size;
+				queued_messages_ -= 1;
+
+				if (write_limits_.policy == overflow_policy::close) {
+					boost::asio::post(ws_.get_executor(),
+						[self = session_base<socket_type>::shared_from_this()] {
+						self->shutdown("slow consumer");
+					});
+				}
+
+				if (pending.handler) {
+					pending.handler(boost::asio::error::no_buffer_space, 0,
+						session_base<socket_type>::shared_from_this());
+				}
+				return false;
+			}
+
+			write_queue_.push(std::move(pending));
+			check_high_watermark(bytes);
+
+			// Raced with a failed write, nobody writes this one anymore
+			if (is_write_failed_) {
+				boost::asio::post(ws_.get_executor(),
+					[self = session_base<socket_type>::shared_from_this()] {
+					self->fail_pending_writes(boost::asio::error::broken_pipe);
+				});
+				return true;
+			}
+
+			// Only the consumer may pop, so dropping happens on the strand
+			if (is_over && !is_trimming_.exchange(true)) {
+				boost::asio::post(ws_.get_executor(),
+					[self = session_base<socket_type>::shared_from_this()] {
+					self->trim_write_queue();
+				});
+			}
+
+			// Only the first producer starts the write loop on the strand
+			if (!is_writing_.exchange(true)) {
+				boost::asio::dispatch(ws_.get_executor(),
+					[self = session_base<socket_type>::shared_from_this()] {
+					self->do_write();
+				});
+			}
+			return true;
+		}
+
+		bool can_make_room() const {
+			return write_limits_.policy == overflow_policy::drop_oldest ||
+				write_limits_.policy == overflow_policy::conflate;
+		}
+
+		// Apply the drop_oldest or conflate policy to the queued messages,
+		// the batch being written is left alone. Messages with a completion
+		// handler are never dropped, the caller may wait on them to continue.
+		void trim_write_queue() {
+			is_trimming_ = false;
+
+			std::vector<pending_write> queued(
+				std::make_move_iterator(write_backlog_.begin()),
+				std::make_move_iterator(write_backlog_.end()));
+			write_backlog_.clear();
+			write_queue_.fetch_while(queued, [](const pending_write&) { return true; });
+
+			// Conflate keeps the newest message that may be dropped
+			bool is_conflate = write_limits_.policy == overflow_policy::conflate;
+			std::size_t newest = queued.size();
+			if (is_conflate) {
+				for (std::size_t i = queued.size(); i-- > 0;) {
+					if (!queued[i].handler) {
+						newest = i;
+						break;
+					}
+				}
+			}
+
+			std::size_t dropped_bytes = 0;
+			std::size_t dropped_messages = 0;
+			for (std::size_t i = 0; i < queued.size(); ++i) {
+				pending_write& pending = queued[i];
+				bool is_dropped = !pending.handler && (is_conflate ? i != newest :
+					is_over_limits(queued_bytes_ - dropped_bytes, queued_messages_ - dropped_messages));
+				if (is_dropped) {
+					dropped_bytes += pending.message.size();
+					++dropped_messages;
+				}
+				else {
+					write_backlog_.push_back(std::move(pending));
+				}
+			}
+
+			if (dropped_messages != 0) {
+				on_dequeued(dropped_bytes, dropped_messages);
+			}
+		}
+
+		void check_high_watermark(std::size_t bytes) {
+			if (write_limits_.high_watermark == 0 || bytes < write_limits_.high_watermark) {
+				return;
+			}
+			if (!above_high_watermark_.exchange(true) && watermark_handler_) {
+				notify_watermark();
+			}
+		}
+
+		void on_dequeued(std::size_t bytes, std::size_t messages) {
+			std::size_t remain = queued_bytes_.fetch_sub(bytes) - bytes;
+			queued_messages_ -= messages;
+
+			if (write_limits_.high_watermark == 0 || remain > write_limits_.low_watermark) {
+				return;
+			}
+			if (above_high_watermark_.exchange(false) && watermark_handler_) {
+				notify_watermark();
+			}
+		}
+
+		// Producers send with their own locks held, the handler may take
+		// them again, so it runs later on the strand. Crossings posted out
+		// of order collapse, the handler sees the state once it runs.
+		void notify_watermark() {
+			boost::asio::post(ws_.get_executor(),
+				[self = session_base<socket_type>::shared_from_this()] {
+				bool is_above = self->above_high_watermark_;
+				if (is_above != self->is_notified_above_) {
+					self->is_notified_above_ = is_above;
+					self->watermark_handler_(is_above, self);
+				}
+			});
+		}
+
+		bool fetch_write_batch() {
+			write_batch_.clear();
+			write_batch_index_ = 0;
+			std::size_t max_bytes = write_batching_ ? max_batch_bytes_ : 0;
+
+			// Kept by trim_write_queue, older than anything still queued
+			if (!write_backlog_.empty()) {
+				std::size_t bytes = 0;
+				while (!write_backlog_.empty()) {
+					std::size_t size = write_backlog_.front().message.size();
+					if (!write_batch_.empty() && bytes + size > max_bytes) {
+						break;
+					}
+					bytes += size;
+					write_batch_.push_back(std::move(write_backlog_.front()));
+					write_backlog_.pop_front();
+				}
+				return true;
+			}
+
+			write_queue_.fetch_batch(write_batch_, max_bytes,
+				[](const pending_write& pending) { return pending.message.size(); });
+			return !write_batch_.empty();
+		}
+
 		void do_write() {
-			ws_.text(true);
+			if (write_batch_index_ == write_batch_.size()) {
+				if (!fetch_write_batch()) {
+					// A producer that saw the flag still set relies on us to
+					// write its message. The exchange acquires its push.
+					is_writing_.exchange(false);
+					if (write_queue_.empty() || is_writing_.exchange(true)) {
+						return;
+					}
+
+					// Counted but not published yet, look again once other
+					// handlers ran instead of spinning on the strand
+					boost::asio::post(ws_.get_executor(),
+						[self = session_base<socket_type>::shared_from_this()] {
+						self->do_write();
+					});
+					return;
+				}
+
+				// Gather the frames of the batch into one socket write
+				if (write_batch_.size() > 1) {
+					batch_layer().cork();
+				}
+			}
+
+			const write_message& message = write_batch_[write_batch_index_].message;
+			ws_.binary(message.is_binary());
+			if (write_meter_) {
+				begin_metering(message.size());
+			}
 			ws_.async_write(
-				boost::asio::buffer(write_queue_.peek()),
+				message.buffers(),
 				[self = session_base<socket_type>::shared_from_this()]
 				(boost::beast::error_code ec,
 				std::size_t bytes_transferred) {
 					self->on_write(ec, bytes_transferred);
 			});
+			if (write_meter_) {
+				write_meter_->discard();
+			}
+		}
+
+		void begin_metering(std::size_t size) {
+			// Below the threshold Beast sends it uncompressed
+			if (is_compression_threshold_supported && size < compression_.threshold) {
+				return;
+			}
+			write_meter_->is_active = true;
+			metered_bytes_ = write_meter_->bytes;
+			metered_cpu_ns_ = write_meter_->cpu_ns;
+			write_meter_->resume();
+		}
+
+		void end_metering(std::size_t size) {
+			if (!write_meter_ || !write_meter_->is_active) {
+				return;
+			}
+			write_meter_->is_active = false;
+			compression_metrics_->messages.add();
+			compression_metrics_->payload_bytes.add(size);
+			compression_metrics_->wire_bytes.add(write_meter_->bytes - metered_bytes_);
+			compression_metrics_->cpu_ns.add(write_meter_->cpu_ns - metered_cpu_ns_);
 		}
 
 		void on_read(
@@ -170,7 +803,7 @@ namespace websocket {
 			}
 
 			std::string received_data = boost::beast::buffers_to_string(read_buffer_.data());
-			log_debug(received_data.c_str());
+			log_debug(received_data);
 
 			if (channel_) {
 				channel_->broadcast(std::move(received_data));
@@ -180,7 +813,7 @@ namespace websocket {
 			read_buffer_.consume(read_buffer_.size());
 
 			// Update message time
-			last_message_ = get_now_epoch();
+			touch();
 
 			// read next
 			auto self(session_base<socket_type>::shared_from_this());
@@ -193,20 +826,115 @@ namespace websocket {
 			boost::beast::error_code ec,
 			std::size_t bytes_transferred)
 		{
-			boost::ignore_unused(bytes_transferred);
+			pending_write& written = write_batch_[write_batch_index_++];
+			end_metering(written.message.size());
+			if (batch_layer().is_corked()) {
+				return on_gathered(ec);
+			}
+
+			auto write_handler = std::move(written.handler);
+			on_dequeued(written.message.size(), 1);
+			written.message = write_message();
+
+			if (ec) {
+				exception_log("write", ec);
+
+				// The stream is broken, is_writing_ stays set so the write loop
+				// is not started again
+				is_write_failed_ = true;
+				if (write_handler) {
+					write_handler(ec, bytes_transferred, session_base<socket_type>::shared_from_this());
+				}
+				fail_pending_writes(ec);
+				return;
+			}
 
+			if (write_handler) {
+				write_handler(ec, bytes_transferred, session_base<socket_type>::shared_from_this());
+			}
+
+			// Already on the strand, continue with the next message directly
+			do_write();
+		}
+
+		// A message of a corked batch was framed, nothing is written until
+		// the whole batch is
+		void on_gathered(boost::beast::error_code ec) {
 			if (ec) {
 				exception_log("write", ec);
+				batch_layer().discard();
+				is_write_failed_ = true;
+				write_batch_index_ = 0;
+				fail_pending_writes(ec);
+				return;
+			}
+
+			if (write_batch_index_ < write_batch_.size()) {
+				do_write();
 				return;
 			}
 
-			write_queue_.consume_one();
+			batch_layer().async_flush(
+				[self = session_base<socket_type>::shared_from_this()]
+				(boost::beast::error_code ec) {
+					self->on_flush(ec);
+			});
+		}
+
+		void on_flush(boost::beast::error_code ec) {
+			if (ec) {
+				exception_log("write", ec);
+				is_write_failed_ = true;
+				write_batch_index_ = 0;
+				fail_pending_writes(ec);
+				return;
+			}
+
+			std::size_t bytes = 0;
+			for (const auto& written : write_batch_) {
+				bytes += written.message.size();
+			}
+			on_dequeued(bytes, write_batch_.size());
 
 			auto self(session_base<socket_type>::shared_from_this());
-			if (!write_queue_.empty()) {
-				io_context_.post([self] {
-					self->do_write();
-				});
+			for (auto& written : write_batch_) {
+				if (written.handler) {
+					auto write_handler = std::move(written.handler);
+					write_handler(ec, written.message.size(), self);
+				}
+				written.message = write_message();
+			}
+
+			do_write();
+		}
+
+		// Complete everything still pending with ec, on the strand
+		void fail_pending_writes(boost::beast::error_code ec) {
+			std::vector<pending_write> failed;
+			for (; write_batch_index_ < write_batch_.size(); ++write_batch_index_) {
+				failed.push_back(std::move(write_batch_[write_batch_index_]));
+			}
+			write_batch_.clear();
+			write_batch_index_ = 0;
+			std::move(write_backlog_.begin(), write_backlog_.end(), std::back_inserter(failed));
+			write_backlog_.clear();
+			write_queue_.fetch_while(failed, [](const pending_write&) { return true; });
+
+			// Producers may still be reserving, so only what was drained is released
+			std::size_t failed_bytes = 0;
+			for (const auto& pending : failed) {
+				failed_bytes += pending.message.size();
+			}
+			on_dequeued(failed_bytes, failed.size());
+
+			if (above_high_watermark_.exchange(false) && watermark_handler_) {
+				notify_watermark();
+			}
+			auto self(session_base<socket_type>::shared_from_this());
+			for (auto& pending : failed) {
+				if (pending.handler) {
+					pending.handler(ec, 0, self);
+				}
 			}
 		}
 
@@ -222,17 +950,6 @@ namespace websocket {
 			});
 		}
 
-		void do_write(AsyncWriteHandler<session_base>&& handler) {
-			ws_.text(true);
-			ws_.async_write(
-				boost::asio::buffer(write_queue_.peek()),
-				[self = session_base<socket_type>::shared_from_this(), write_handler = std::move(handler)]
-			(boost::beast::error_code ec,
-				std::size_t bytes_transferred) mutable {
-				self->on_write(ec, bytes_transferred, std::move(write_handler));
-			});
-		}
-
 		void on_read(
 			boost::beast::error_code ec,
 			std::size_t bytes_transferred,
@@ -258,33 +975,66 @@ namespace websocket {
 			log_debug(received_data);
 
 			// Update message time
-			last_message_ = get_now_epoch();
+			touch();
 
 			if (read_handler) {
 				read_handler(ec, bytes_transferred, std::move(received_data), session_base<socket_type>::shared_from_this());
 			}
 		}
 
-		void on_write(
+		void do_read_view(AsyncReadViewHandler<session_base>&& handler) {
+			ws_.async_read(
+				read_buffer_,
+				[self = session_base<socket_type>::shared_from_this(), read_handler = std::move(handler)]
+			(boost::beast::error_code ec,
+				std::size_t bytes_transferred) mutable {
+				self->on_read_view(ec, bytes_transferred, std::move(read_handler));
+			});
+		}
+
+		void on_read_view(
 			boost::beast::error_code ec,
 			std::size_t bytes_transferred,
-			AsyncWriteHandler<session_base>&& write_handler) {
-
-			boost::ignore_unused(bytes_transferred);
+			AsyncReadViewHandler<session_base>&& read_handler)
+		{
+			// This indicates that the session was closed
+			if (ec == boost::beast::websocket::error::closed) {
+				return;
+			}
 
 			if (ec) {
-				exception_log("write", ec);
+				exception_log("read", ec);
 				return;
 			}
 
-			write_queue_.consume_one();
+			// Terminate the data in place, prepare may move the readable bytes
+			auto tail = read_buffer_.prepare(1);
+			static_cast<char*>(tail.data())[0] = '\0';
+			std::string_view received_data(
+				static_cast<const char*>(read_buffer_.data().data()), read_buffer_.size());
 
-			if (write_handler) {
-				write_handler(ec, bytes_transferred, session_base<socket_type>::shared_from_this());
+			log_debug(received_data);
+
+			// Update message time
+			touch();
+
+			if (read_handler) {
+				is_delivering_ = true;
+				read_handler(ec, bytes_transferred, received_data, session_base<socket_type>::shared_from_this());
+				is_delivering_ = false;
+			}
+
+			// Clear the buffer
+			read_buffer_.consume(read_buffer_.size());
+
+			if (pending_view_handler_) {
+				auto handler = std::move(pending_view_handler_);
+				pending_view_handler_ = nullptr;
+				do_read_view(std::move(handler));
 			}
 		}
 	};
 	
-	using tcp_session = session_base<boost::beast::tcp_stream>;
-	using ssl_session = session_base<boost::beast::ssl_stream<boost::beast::tcp_stream>>;
+	using tcp_session = session_base<metered_stream<batch_stream<boost::beast::tcp_stream>>>;
+	using ssl_session = session_base<metered_stream<batch_stream<tls_stream>>>;
 }
\ No newline at end of file
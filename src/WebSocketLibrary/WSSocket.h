@@ -0,0 +1,110 @@
+#pragma once
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/detail/socket_option.hpp>
+
+#include "WSDefinition.h"
+
+namespace websocket {
+	namespace tcp_option {
+#if defined(TCP_QUICKACK)
+		using quick_ack = boost::asio::detail::socket_option::boolean<IPPROTO_TCP, TCP_QUICKACK>;
+#endif
+#if defined(TCP_USER_TIMEOUT)
+		using user_timeout = boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_USER_TIMEOUT>;
+#endif
+#if defined(TCP_DEFER_ACCEPT)
+		using defer_accept = boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_DEFER_ACCEPT>;
+#endif
+#if defined(TCP_KEEPIDLE)
+		using keep_alive_idle = boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_KEEPIDLE>;
+#elif defined(TCP_KEEPALIVE)
+		using keep_alive_idle = boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_KEEPALIVE>;
+#endif
+#if defined(TCP_KEEPINTVL)
+		using keep_alive_interval = boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_KEEPINTVL>;
+#endif
+#if defined(TCP_KEEPCNT)
+		using keep_alive_count = boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_KEEPCNT>;
+#endif
+	}
+
+	// Options below stop at the first failure, the socket stays usable
+	// with the options set so far.
+
+	// Accepted sockets inherit these from the acceptor
+	template<typename Socket>
+	void set_buffer_sizes(Socket& socket, const socket_options& options, boost::system::error_code& ec) {
+		if (options.send_buffer_size > 0) {
+			socket.set_option(boost::asio::socket_base::send_buffer_size(options.send_buffer_size), ec);
+			if (ec) return;
+		}
+		if (options.receive_buffer_size > 0) {
+			socket.set_option(boost::asio::socket_base::receive_buffer_size(options.receive_buffer_size), ec);
+			if (ec) return;
+		}
+	}
+
+	// Set on every connected socket
+	template<typename Socket>
+	void set_connection_options(Socket& socket, const socket_options& options, boost::system::error_code& ec) {
+		socket.set_option(boost::asio::ip::tcp::no_delay(options.no_delay), ec);
+		if (ec) return;
+
+#if defined(TCP_QUICKACK)
+		// Not sticky, the kernel may fall back to delayed acks later
+		if (options.quick_ack) {
+			socket.set_option(tcp_option::quick_ack(true), ec);
+			if (ec) return;
+		}
+#endif
+
+#if defined(TCP_USER_TIMEOUT)
+		if (options.user_timeout.count() > 0) {
+			socket.set_option(tcp_option::user_timeout(static_cast<int>(options.user_timeout.count())), ec);
+			if (ec) return;
+		}
+#endif
+
+		if (!options.keep_alive) {
+			return;
+		}
+		socket.set_option(boost::asio::socket_base::keep_alive(true), ec);
+		if (ec) return;
+#if defined(TCP_KEEPIDLE) || defined(TCP_KEEPALIVE)
+		if (options.keep_alive_idle.count() > 0) {
+			socket.set_option(tcp_option::keep_alive_idle(static_cast<int>(options.keep_alive_idle.count())), ec);
+			if (ec) return;
+		}
+#endif
+#if defined(TCP_KEEPINTVL)
+		if (options.keep_alive_interval.count() > 0) {
+			socket.set_option(tcp_option::keep_alive_interval(static_cast<int>(options.keep_alive_interval.count())), ec);
+			if (ec) return;
+		}
+#endif
+#if defined(TCP_KEEPCNT)
+		if (options.keep_alive_count > 0) {
+			socket.set_option(tcp_option::keep_alive_count(options.keep_alive_count), ec);
+			if (ec) return;
+		}
+#endif
+	}
+
+	// Set on an open acceptor before listen. The buffer sizes must be
+	// known before the TCP handshake to take part in window scaling.
+	inline void set_listen_options(boost::asio::ip::tcp::acceptor& acceptor, const socket_options& options, boost::system::error_code& ec) {
+		set_buffer_sizes(acceptor, options, ec);
+		if (ec) return;
+
+#if defined(TCP_DEFER_ACCEPT)
+		if (options.defer_accept.count() > 0) {
+			acceptor.set_option(tcp_option::defer_accept(static_cast<int>(options.defer_accept.count())), ec);
+			if (ec) return;
+		}
+#endif
+	}
+
+	inline int listen_backlog(const socket_options& options) {
+		return options.backlog > 0 ? options.backlog : boost::asio::socket_base::max_listen_connections;
+	}
+}
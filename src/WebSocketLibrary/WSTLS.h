@@ -0,0 +1,223 @@
+#pragma once
+#include <boost/asio/ssl/context.hpp>
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+#include "WSDefinition.h"
+#include "WSLogger.h"
+
+namespace websocket {
+	// Keys encrypting session tickets. A new key replaces the current one
+	// every rotation interval, tickets of the previous key still resume
+	// and are renewed, older tickets fall back to a full handshake.
+	class TicketKeyRing {
+		struct key {
+			std::array<unsigned char, 16> name;
+			std::array<unsigned char, 32> aes;
+			std::array<unsigned char, 32> hmac;
+			std::chrono::steady_clock::time_point created;
+		};
+
+		std::mutex mutex_;
+		key current_;
+		key previous_;
+		bool has_previous_;
+		std::chrono::seconds rotation_;
+
+	public:
+		explicit TicketKeyRing(std::chrono::seconds rotation)
+			: has_previous_(false)
+			, rotation_(rotation)
+		{
+			generate(current_);
+		}
+
+		// Install on ctx, which keeps the ring alive
+		static bool install(SSL_CTX* ctx, std::shared_ptr<TicketKeyRing> ring) {
+			int index = ex_data_index();
+			if (index < 0) {
+				return false;
+			}
+			auto holder = static_cast<std::shared_ptr<TicketKeyRing>*>(SSL_CTX_get_ex_data(ctx, index));
+			if (holder) {
+				// Installed before, the old ring is released
+				*holder = std::move(ring);
+			}
+			else {
+				holder = new std::shared_ptr<TicketKeyRing>(std::move(ring));
+				if (!SSL_CTX_set_ex_data(ctx, index, holder)) {
+					delete holder;
+					return false;
+				}
+			}
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+			return SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, &TicketKeyRing::on_ticket) == 1;
+#else
+			return SSL_CTX_set_tlsext_ticket_key_cb(ctx, &TicketKeyRing::on_ticket) == 1;
+#endif
+		}
+
+		// Retire the current key now, for example when it may have leaked
+		void rotate() {
+			std::lock_guard<std::mutex> guard(mutex_);
+			rotate_locked();
+		}
+
+	private:
+		static int ex_data_index() {
+			static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, &TicketKeyRing::free_holder);
+			return index;
+		}
+
+		static void free_holder(void*, void* ptr, CRYPTO_EX_DATA*, int, long, void*) {
+			delete static_cast<std::shared_ptr<TicketKeyRing>*>(ptr);
+		}
+
+		static void generate(key& k) {
+			RAND_bytes(k.name.data(), static_cast<int>(k.name.size()));
+			RAND_bytes(k.aes.data(), static_cast<int>(k.aes.size()));
+			RAND_bytes(k.hmac.data(), static_cast<int>(k.hmac.size()));
+			k.created = std::chrono::steady_clock::now();
+		}
+
+		void rotate_locked() {
+			previous_ = current_;
+			has_previous_ = true;
+			generate(current_);
+		}
+
+		// Key to encrypt a new ticket with
+		key encrypt_key() {
+			std::lock_guard<std::mutex> guard(mutex_);
+			if (std::chrono::steady_clock::now() - current_.created >= rotation_) {
+				rotate_locked();
+			}
+			return current_;
+		}
+
+		// Key named by a received ticket, 0 if unknown, 2 if it needs renewal
+		int decrypt_key(const unsigned char* name, key& k) {
+			std::lock_guard<std::mutex> guard(mutex_);
+			if (std::memcmp(name, current_.name.data(), current_.name.size()) == 0) {
+				k = current_;
+				return 1;
+			}
+			if (has_previous_ &&
+				std::memcmp(name, previous_.name.data(), previous_.name.size()) == 0 &&
+				std::chrono::steady_clock::now() - previous_.created < rotation_ * 2) {
+				k = previous_;
+				return 2;
+			}
+			return 0;
+		}
+
+		static TicketKeyRing* from(SSL* ssl) {
+			auto holder = static_cast<std::shared_ptr<TicketKeyRing>*>(
+				SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ex_data_index()));
+			return holder ? holder->get() : nullptr;
+		}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+		using mac_context = EVP_MAC_CTX;
+
+		static bool init_mac(EVP_MAC_CTX* mac, key& k) {
+			char digest[] = "SHA256";
+			OSSL_PARAM params[] = {
+				OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, k.hmac.data(), k.hmac.size()),
+				OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+				OSSL_PARAM_construct_end()
+			};
+			return EVP_MAC_CTX_set_params(mac, params) == 1;
+		}
+#else
+		using mac_context = HMAC_CTX;
+
+		static bool init_mac(HMAC_CTX* mac, key& k) {
+			return HMAC_Init_ex(mac, k.hmac.data(), static_cast<int>(k.hmac.size()), EVP_sha256(), nullptr) == 1;
+		}
+#endif
+
+		// OpenSSL ticket key callback, returns -1 on error, 0 for an unknown
+		// key, 1 on success and 2 when the ticket should be renewed
+		static int on_ticket(SSL* ssl, unsigned char* name, unsigned char* iv,
+			EVP_CIPHER_CTX* cipher, mac_context* mac, int encrypt) {
+			TicketKeyRing* ring = from(ssl);
+			if (!ring) {
+				return -1;
+			}
+
+			key k;
+			if (encrypt) {
+				k = ring->encrypt_key();
+				std::memcpy(name, k.name.data(), k.name.size());
+				if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1 ||
+					EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, k.aes.data(), iv) != 1 ||
+					!init_mac(mac, k)) {
+					return -1;
+				}
+				return 1;
+			}
+
+			int result = ring->decrypt_key(name, k);
+			if (result == 0) {
+				return 0;
+			}
+			if (!init_mac(mac, k) ||
+				EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, k.aes.data(), iv) != 1) {
+				return -1;
+			}
+			return result;
+		}
+	};
+
+	// Let reconnecting clients skip the full handshake, from the in memory
+	// session cache or with a ticket. Return the ticket key ring, nullptr
+	// when tickets are off or could not be set up. Pass the ring of the
+	// context being replaced to keep its tickets valid.
+	inline std::shared_ptr<TicketKeyRing> enable_tls_resumption(
+		boost::asio::ssl::context& context, const tls_resumption_options& options,
+		std::shared_ptr<TicketKeyRing> ring = nullptr) {
+		SSL_CTX* ctx = context.native_handle();
+
+		// Sessions are only resumed within the same id context
+		static const unsigned char id_context[] = "websocket";
+		SSL_CTX_set_session_id_context(ctx, id_context, sizeof(id_context) - 1);
+		SSL_CTX_set_timeout(ctx, static_cast<long>(options.timeout.count()));
+
+		if (options.cache_size > 0) {
+			SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+			SSL_CTX_sess_set_cache_size(ctx, static_cast<long>(options.cache_size));
+		}
+		else {
+			SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+		}
+
+		if (!options.tickets) {
+			SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+			return nullptr;
+		}
+
+		SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+		if (!ring) {
+			ring = std::make_shared<TicketKeyRing>(options.ticket_key_rotation);
+		}
+		if (!TicketKeyRing::install(ctx, ring)) {
+			log("Failed to set the TLS ticket key callback, tickets use the OpenSSL default key");
+			return nullptr;
+		}
+		return ring;
+	}
+}
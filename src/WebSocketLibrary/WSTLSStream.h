@@ -0,0 +1,542 @@
+#pragma once
+#include <boost/beast/core.hpp>
+#include <boost/beast/ssl/ssl_stream.hpp>
+#include <boost/beast/websocket/ssl.hpp>
+#include <boost/beast/websocket/teardown.hpp>
+
+#include <openssl/evp.h>
+#include <openssl/opensslv.h>
+#include <openssl/ssl.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+// The keys are derived with the TLS 1.3 API of OpenSSL 1.1.1
+#if defined(__linux__) && __has_include(<linux/tls.h>) && OPENSSL_VERSION_NUMBER >= 0x10101000L
+#include <openssl/kdf.h>
+#include <linux/tls.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#define WS_HAS_KTLS 1
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#endif
+
+namespace websocket {
+	// Directions of a TLS stream whose records the kernel encrypts
+	enum class ktls_mode {
+		none,
+		send,
+		send_receive
+	};
+
+	// Linux kernel TLS. OpenSSL only enables it itself on socket BIOs, the
+	// memory BIO of asio never qualifies, so the keys are derived here and
+	// handed to the kernel after the handshake. AES-GCM of TLS 1.2 and 1.3.
+	namespace ktls {
+#if defined(WS_HAS_KTLS)
+		// Set once the kernel has no TLS module, later sessions skip the attempt
+		inline std::atomic<bool>& is_missing() {
+			static std::atomic<bool> missing(false);
+			return missing;
+		}
+
+		// TLS 1.3 traffic secrets of one connection, from the key log callback
+		struct secrets {
+			std::vector<unsigned char> client;
+			std::vector<unsigned char> server;
+
+			~secrets() {
+				if (!client.empty()) OPENSSL_cleanse(client.data(), client.size());
+				if (!server.empty()) OPENSSL_cleanse(server.data(), server.size());
+			}
+		};
+
+		inline void free_secrets(void*, void* ptr, CRYPTO_EX_DATA*, int, long, void*) {
+			delete static_cast<secrets*>(ptr);
+		}
+
+		inline int secrets_index() {
+			static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, &free_secrets);
+			return index;
+		}
+
+		inline bool from_hex(const char* text, size_t length, std::vector<unsigned char>& out) {
+			if (length % 2 != 0) {
+				return false;
+			}
+			out.resize(length / 2);
+			for (size_t i = 0; i < out.size(); ++i) {
+				unsigned int byte = 0;
+				for (size_t j = 0; j < 2; ++j) {
+					char c = text[i * 2 + j];
+					byte <<= 4;
+					if (c >= '0' && c <= '9') byte |= c - '0';
+					else if (c >= 'a' && c <= 'f') byte |= c - 'a' + 10;
+					else if (c >= 'A' && c <= 'F') byte |= c - 'A' + 10;
+					else return false;
+				}
+				out[i] = static_cast<unsigned char>(byte);
+			}
+			return true;
+		}
+
+		// "<label> <client random> <secret>" in hex
+		inline void on_key_log(const SSL* ssl, const char* line) {
+			const char* client_label = "CLIENT_TRAFFIC_SECRET_0 ";
+			const char* server_label = "SERVER_TRAFFIC_SECRET_0 ";
+			bool is_client = std::strncmp(line, client_label, std::strlen(client_label)) == 0;
+			bool is_server = std::strncmp(line, server_label, std::strlen(server_label)) == 0;
+			if (!is_client && !is_server) {
+				return;
+			}
+			const char* secret = std::strrchr(line, ' ');
+			if (!secret) {
+				return;
+			}
+			++secret;
+
+			SSL* s = const_cast<SSL*>(ssl);
+			auto saved = static_cast<secrets*>(SSL_get_ex_data(s, secrets_index()));
+			if (!saved) {
+				saved = new secrets();
+				if (!SSL_set_ex_data(s, secrets_index(), saved)) {
+					delete saved;
+					return;
+				}
+			}
+			from_hex(secret, std::strlen(secret), is_client ? saved->client : saved->server);
+		}
+
+		// HKDF-Expand-Label of RFC 8446 with an empty context
+		inline bool expand_label(const EVP_MD* md, const std::vector<unsigned char>& secret,
+			const std::string& label, unsigned char* out, size_t length) {
+			std::string full_label = "tls13 " + label;
+			std::vector<unsigned char> info;
+			info.push_back(static_cast<unsigned char>(length >> 8));
+			info.push_back(static_cast<unsigned char>(length));
+			info.push_back(static_cast<unsigned char>(full_label.size()));
+			info.insert(info.end(), full_label.begin(), full_label.end());
+			info.push_back(0);
+
+			EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+			if (!ctx) {
+				return false;
+			}
+			size_t out_length = length;
+			bool ok = EVP_PKEY_derive_init(ctx) > 0 &&
+				EVP_PKEY_CTX_hkdf_mode(ctx, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) > 0 &&
+				EVP_PKEY_CTX_set_hkdf_md(ctx, md) > 0 &&
+				EVP_PKEY_CTX_set1_hkdf_key(ctx, secret.data(), static_cast<int>(secret.size())) > 0 &&
+				EVP_PKEY_CTX_add1_hkdf_info(ctx, info.data(), static_cast<int>(info.size())) > 0 &&
+				EVP_PKEY_derive(ctx, out, &out_length) > 0 &&
+				out_length == length;
+			EVP_PKEY_CTX_free(ctx);
+			return ok;
+		}
+
+		// TLS 1.2 key block, client key, server key, client salt, server salt
+		inline bool key_block(SSL* ssl, const EVP_MD* md, unsigned char* out, size_t length) {
+			unsigned char master[SSL_MAX_MASTER_KEY_LENGTH];
+			size_t master_length = SSL_SESSION_get_master_key(SSL_get_session(ssl), master, sizeof(master));
+			unsigned char client_random[SSL3_RANDOM_SIZE];
+			unsigned char server_random[SSL3_RANDOM_SIZE];
+			SSL_get_client_random(ssl, client_random, sizeof(client_random));
+			SSL_get_server_random(ssl, server_random, sizeof(server_random));
+
+			EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_TLS1_PRF, nullptr);
+			if (!ctx) {
+				OPENSSL_cleanse(master, sizeof(master));
+				return false;
+			}
+			static const char label[] = "key expansion";
+			size_t out_length = length;
+			bool ok = master_length > 0 &&
+				EVP_PKEY_derive_init(ctx) > 0 &&
+				EVP_PKEY_CTX_set_tls1_prf_md(ctx, md) > 0 &&
+				EVP_PKEY_CTX_set1_tls1_prf_secret(ctx, master, static_cast<int>(master_length)) > 0 &&
+				EVP_PKEY_CTX_add1_tls1_prf_seed(ctx, reinterpret_cast<const unsigned char*>(label), sizeof(label) - 1) > 0 &&
+				EVP_PKEY_CTX_add1_tls1_prf_seed(ctx, server_random, sizeof(server_random)) > 0 &&
+				EVP_PKEY_CTX_add1_tls1_prf_seed(ctx, client_random, sizeof(client_random)) > 0 &&
+				EVP_PKEY_derive(ctx, out, &out_length) > 0 &&
+				out_length == length;
+			EVP_PKEY_CTX_free(ctx);
+			OPENSSL_cleanse(master, sizeof(master));
+			return ok;
+		}
+
+		// Key, 4 byte salt and 8 byte explicit iv of one direction
+		struct traffic_keys {
+			unsigned char key[32];
+			size_t key_length;
+			unsigned char salt[4];
+			unsigned char iv[8];
+			unsigned char sequence[8];
+			int version;
+
+			~traffic_keys() {
+				OPENSSL_cleanse(key, sizeof(key));
+			}
+		};
+
+		// Keys of the records ssl sends, or receives, starting at sequence.
+		// TLS 1.3 keys are taken after update key updates of the direction.
+		inline bool derive(SSL* ssl, bool sending, int updates, uint64_t sequence, traffic_keys& keys) {
+			const SSL_CIPHER* cipher = SSL_get_current_cipher(ssl);
+			if (!cipher) {
+				return false;
+			}
+			int nid = SSL_CIPHER_get_cipher_nid(cipher);
+			if (nid == NID_aes_128_gcm) keys.key_length = 16;
+			else if (nid == NID_aes_256_gcm) keys.key_length = 32;
+			else return false;
+
+			const EVP_MD* md = SSL_CIPHER_get_handshake_digest(cipher);
+			if (!md) {
+				return false;
+			}
+			bool server_keys = (SSL_is_server(ssl) == 1) == sending;
+			keys.version = SSL_version(ssl);
+			for (int i = 7; i >= 0; --i) {
+				keys.sequence[i] = static_cast<unsigned char>(sequence);
+				sequence >>= 8;
+			}
+
+			if (keys.version == TLS1_3_VERSION) {
+				auto saved = static_cast<secrets*>(SSL_get_ex_data(ssl, secrets_index()));
+				if (!saved) {
+					return false;
+				}
+				std::vector<unsigned char> secret = server_keys ? saved->server : saved->client;
+				if (secret.empty()) {
+					return false;
+				}
+				for (int i = 0; i < updates; ++i) {
+					std::vector<unsigned char> next(secret.size());
+					if (!expand_label(md, secret, "traffic upd", next.data(), next.size())) {
+						return false;
+					}
+					OPENSSL_cleanse(secret.data(), secret.size());
+					secret.swap(next);
+				}
+				unsigned char iv[12];
+				bool ok = expand_label(md, secret, "key", keys.key, keys.key_length) &&
+					expand_label(md, secret, "iv", iv, sizeof(iv));
+				OPENSSL_cleanse(secret.data(), secret.size());
+				std::memcpy(keys.salt, iv, sizeof(keys.salt));
+				std::memcpy(keys.iv, iv + sizeof(keys.salt), sizeof(keys.iv));
+				return ok;
+			}
+
+			if (keys.version == TLS1_2_VERSION) {
+				unsigned char block[2 * 32 + 2 * 4];
+				size_t length = 2 * keys.key_length + 2 * sizeof(keys.salt);
+				if (!key_block(ssl, md, block, length)) {
+					return false;
+				}
+				const unsigned char* key = block + (server_keys ? keys.key_length : 0);
+				const unsigned char* salt = block + 2 * keys.key_length + (server_keys ? sizeof(keys.salt) : 0);
+				std::memcpy(keys.key, key, keys.key_length);
+				std::memcpy(keys.salt, salt, sizeof(keys.salt));
+				// The explicit nonce only has to be unique, OpenSSL uses the sequence
+				std::memcpy(keys.iv, keys.sequence, sizeof(keys.iv));
+				OPENSSL_cleanse(block, sizeof(block));
+				return true;
+			}
+			return false;
+		}
+
+		template<typename Info>
+		bool install(int fd, int direction, const traffic_keys& keys) {
+			Info info;
+			std::memset(&info, 0, sizeof(info));
+			info.info.version = keys.version == TLS1_3_VERSION ? TLS_1_3_VERSION : TLS_1_2_VERSION;
+			info.info.cipher_type = sizeof(info.key) == 16 ? TLS_CIPHER_AES_GCM_128 : TLS_CIPHER_AES_GCM_256;
+			std::memcpy(info.key, keys.key, sizeof(info.key));
+			std::memcpy(info.salt, keys.salt, sizeof(info.salt));
+			std::memcpy(info.iv, keys.iv, sizeof(info.iv));
+			std::memcpy(info.rec_seq, keys.sequence, sizeof(info.rec_seq));
+			bool ok = setsockopt(fd, SOL_TLS, direction, &info, sizeof(info)) == 0;
+			OPENSSL_cleanse(&info, sizeof(info));
+			return ok;
+		}
+
+		// Hand one direction of fd to the kernel
+		inline bool install(int fd, int direction, const traffic_keys& keys) {
+			if (keys.key_length == 16) {
+				return install<tls12_crypto_info_aes_gcm_128>(fd, direction, keys);
+			}
+			return install<tls12_crypto_info_aes_gcm_256>(fd, direction, keys);
+		}
+
+		// Attach the TLS upper layer protocol to fd
+		inline bool attach(int fd) {
+			if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) == 0) {
+				return true;
+			}
+			if (errno == ENOENT || errno == ENOPROTOOPT) {
+				is_missing() = true;
+			}
+			return false;
+		}
+
+		// Send a close_notify alert through the kernel
+		inline void send_close_notify(int fd) {
+			unsigned char alert[2] = { 1, 0 };
+			char control[CMSG_SPACE(sizeof(unsigned char))];
+			std::memset(control, 0, sizeof(control));
+
+			iovec data;
+			data.iov_base = alert;
+			data.iov_len = sizeof(alert);
+
+			msghdr message;
+			std::memset(&message, 0, sizeof(message));
+			message.msg_iov = &data;
+			message.msg_iovlen = 1;
+			message.msg_control = control;
+			message.msg_controllen = sizeof(control);
+
+			cmsghdr* header = CMSG_FIRSTHDR(&message);
+			header->cmsg_level = SOL_TLS;
+			header->cmsg_type = TLS_SET_RECORD_TYPE;
+			header->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+			*CMSG_DATA(header) = 21;	// alert
+
+			// Best effort, the connection closes either way
+			sendmsg(fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+		}
+#endif
+
+		// Compiled in and not known to be missing from the kernel
+		inline bool is_available() {
+#if defined(WS_HAS_KTLS)
+			return !is_missing();
+#else
+			return false;
+#endif
+		}
+
+		// Let the sessions of context move to kernel TLS. Takes the key log
+		// callback of the context, and refuses TLS 1.2 renegotiation which
+		// the kernel could not follow. Returns false when not compiled in.
+		inline bool prepare(boost::asio::ssl::context& context) {
+#if defined(WS_HAS_KTLS)
+			SSL_CTX_set_keylog_callback(context.native_handle(), &on_key_log);
+#if defined(SSL_OP_NO_RENEGOTIATION)
+			SSL_CTX_set_options(context.native_handle(), SSL_OP_NO_RENEGOTIATION);
+#endif
+			return true;
+#else
+			(void)context;
+			return false;
+#endif
+		}
+	}
+
+	// SSL stream whose record layer can move into the kernel once the
+	// handshake is done, see async_enable_ktls. Until then, and where kTLS
+	// is not available, it is a plain ssl_stream.
+	class tls_stream {
+	public:
+		using next_layer_type = boost::beast::ssl_stream<boost::beast::tcp_stream>;
+		using executor_type = next_layer_type::executor_type;
+
+	private:
+		next_layer_type stream_;
+		ktls_mode ktls_;
+
+	public:
+		tls_stream(boost::asio::ip::tcp::socket&& socket, boost::asio::ssl::context& ctx)
+			: stream_(std::move(socket), ctx)
+			, ktls_(ktls_mode::none) {
+		}
+
+		executor_type get_executor() noexcept {
+			return stream_.get_executor();
+		}
+
+		next_layer_type& next_layer() noexcept {
+			return stream_;
+		}
+
+		const next_layer_type& next_layer() const noexcept {
+			return stream_;
+		}
+
+		SSL* native_handle() {
+			return stream_.native_handle();
+		}
+
+		ktls_mode ktls() const {
+			return ktls_;
+		}
+
+		template<typename HandshakeHandler>
+		auto async_handshake(boost::asio::ssl::stream_base::handshake_type type, HandshakeHandler&& handler) {
+			return stream_.async_handshake(type, std::forward<HandshakeHandler>(handler));
+		}
+
+		template<typename MutableBufferSequence>
+		std::size_t read_some(const MutableBufferSequence& buffers, boost::beast::error_code& ec) {
+			if (ktls_ == ktls_mode::send_receive) {
+				return boost::beast::get_lowest_layer(stream_).socket().read_some(buffers, ec);
+			}
+			return stream_.read_some(buffers, ec);
+		}
+
+		template<typename MutableBufferSequence>
+		std::size_t read_some(const MutableBufferSequence& buffers) {
+			boost::beast::error_code ec;
+			auto bytes = read_some(buffers, ec);
+			if (ec) {
+				BOOST_THROW_EXCEPTION(boost::system::system_error{ ec });
+			}
+			return bytes;
+		}
+
+		template<typename ConstBufferSequence>
+		std::size_t write_some(const ConstBufferSequence& buffers, boost::beast::error_code& ec) {
+			if (ktls_ != ktls_mode::none) {
+				return boost::beast::get_lowest_layer(stream_).socket().write_some(buffers, ec);
+			}
+			return stream_.write_some(buffers, ec);
+		}
+
+		template<typename ConstBufferSequence>
+		std::size_t write_some(const ConstBufferSequence& buffers) {
+			boost::beast::error_code ec;
+			auto bytes = write_some(buffers, ec);
+			if (ec) {
+				BOOST_THROW_EXCEPTION(boost::system::system_error{ ec });
+			}
+			return bytes;
+		}
+
+		template<typename MutableBufferSequence, typename ReadHandler>
+		auto async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler) {
+			if (ktls_ == ktls_mode::send_receive) {
+				return boost::beast::get_lowest_layer(stream_).async_read_some(buffers, std::forward<ReadHandler>(handler));
+			}
+			return stream_.async_read_some(buffers, std::forward<ReadHandler>(handler));
+		}
+
+		template<typename ConstBufferSequence, typename WriteHandler>
+		auto async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler) {
+			if (ktls_ != ktls_mode::none) {
+				return boost::beast::get_lowest_layer(stream_).async_write_some(buffers, std::forward<WriteHandler>(handler));
+			}
+			return stream_.async_write_some(buffers, std::forward<WriteHandler>(handler));
+		}
+
+		// Move the record layer into the kernel after the handshake. Falls
+		// back to OpenSSL without an error where the cipher, the protocol
+		// version or the kernel does not allow it, see ktls(). Receiving
+		// only moves when no record was buffered during the handshake. Key
+		// updates requested by the peer end the connection afterwards.
+		void async_enable_ktls(std::function<void(boost::beast::error_code)>&& handler) {
+#if defined(WS_HAS_KTLS)
+			SSL* ssl = native_handle();
+			if (!ktls::is_available() || SSL_version(ssl) != TLS1_3_VERSION) {
+				if (ktls::is_available()) {
+					enable_ktls(0);
+				}
+				return boost::asio::post(stream_.get_executor(),
+					[handler = std::move(handler)]() { handler({}); });
+			}
+
+			// How many records went out under the first TLS 1.3 key is not
+			// known, tickets among them. A key update starts sending over
+			// with the next key at sequence zero.
+			if (SSL_key_update(ssl, SSL_KEY_UPDATE_NOT_REQUESTED) != 1) {
+				return boost::asio::post(stream_.get_executor(),
+					[handler = std::move(handler)]() { handler({}); });
+			}
+			stream_.async_handshake(boost::asio::ssl::stream_base::server,
+				[this, handler = std::move(handler)](boost::beast::error_code ec) {
+				if (!ec) {
+					enable_ktls(1);
+				}
+				handler(ec);
+			});
+#else
+			boost::asio::post(stream_.get_executor(),
+				[handler = std::move(handler)]() { handler({}); });
+#endif
+		}
+
+		template<typename TeardownHandler>
+		void async_teardown(boost::beast::role_type role, TeardownHandler&& handler) {
+#if defined(WS_HAS_KTLS)
+			if (ktls_ != ktls_mode::none) {
+				ktls::send_close_notify(static_cast<int>(boost::beast::get_lowest_layer(stream_).socket().native_handle()));
+				using boost::beast::websocket::async_teardown;
+				return async_teardown(role, boost::beast::get_lowest_layer(stream_).socket(), std::forward<TeardownHandler>(handler));
+			}
+#endif
+			using boost::beast::async_teardown;
+			async_teardown(role, stream_, std::forward<TeardownHandler>(handler));
+		}
+
+		void teardown(boost::beast::role_type role, boost::beast::error_code& ec) {
+#if defined(WS_HAS_KTLS)
+			if (ktls_ != ktls_mode::none) {
+				ktls::send_close_notify(static_cast<int>(boost::beast::get_lowest_layer(stream_).socket().native_handle()));
+				using boost::beast::websocket::teardown;
+				return teardown(role, boost::beast::get_lowest_layer(stream_).socket(), ec);
+			}
+#endif
+			using boost::beast::teardown;
+			teardown(role, stream_, ec);
+		}
+
+	private:
+#if defined(WS_HAS_KTLS)
+		// TLS 1.2 records of both sides continue at sequence one after the Finished messages
+		void enable_ktls(int updates) {
+			SSL* ssl = native_handle();
+			uint64_t sequence = updates > 0 ? 0 : 1;
+			if (SSL_version(ssl) != TLS1_2_VERSION && SSL_version(ssl) != TLS1_3_VERSION) {
+				return;
+			}
+
+			ktls::traffic_keys send_keys;
+			if (!ktls::derive(ssl, true, updates, sequence, send_keys)) {
+				return;
+			}
+			int fd = static_cast<int>(boost::beast::get_lowest_layer(stream_).socket().native_handle());
+			if (!ktls::attach(fd) || !ktls::install(fd, TLS_TX, send_keys)) {
+				return;
+			}
+			ktls_ = ktls_mode::send;
+
+			// Records read ahead during the handshake are only known to OpenSSL
+			if (BIO_ctrl_pending(SSL_get_rbio(ssl)) != 0 || SSL_has_pending(ssl)) {
+				return;
+			}
+			ktls::traffic_keys receive_keys;
+			if (ktls::derive(ssl, false, 0, SSL_version(ssl) == TLS1_3_VERSION ? 0 : 1, receive_keys) &&
+				ktls::install(fd, TLS_RX, receive_keys)) {
+				ktls_ = ktls_mode::send_receive;
+			}
+		}
+#endif
+	};
+
+	template<typename TeardownHandler>
+	void async_teardown(boost::beast::role_type role, tls_stream& stream, TeardownHandler&& handler) {
+		stream.async_teardown(role, std::forward<TeardownHandler>(handler));
+	}
+
+	inline void teardown(boost::beast::role_type role, tls_stream& stream, boost::beast::error_code& ec) {
+		stream.teardown(role, ec);
+	}
+}
@@ -0,0 +1,232 @@
+#pragma once
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace websocket {
+	// Hierarchical timing wheel for idle timeouts, one per io_context.
+	//
+	// An entry is added once and refreshed with touch(), which is a single
+	// relaxed store and never takes the lock. When the slot of an entry
+	// comes due the wheel compares its last activity with the timeout, and
+	// either expires it or moves it to the slot of its new deadline. An
+	// active entry is therefore moved at most once per timeout period.
+	//
+	// Level 0 has one slot per tick, level 1 one slot per level 0 turn.
+	// Deadlines beyond level 1 are parked in its last slot and moved again.
+	class TimingWheel : public std::enable_shared_from_this<TimingWheel> {
+		using clock_type = std::atomic<uint64_t>;
+
+	public:
+		class entry {
+			friend class TimingWheel;
+
+			std::shared_ptr<const clock_type> clock_;
+			std::atomic<uint64_t> last_active_;
+			std::atomic<bool> cancelled_;
+			uint64_t timeout_;
+			std::function<void()> on_expired_;
+		public:
+			entry(std::shared_ptr<const clock_type> clock, uint64_t timeout, std::function<void()>&& on_expired)
+				: clock_(std::move(clock))
+				, last_active_(clock_->load(std::memory_order_relaxed))
+				, cancelled_(false)
+				, timeout_(timeout)
+				, on_expired_(std::move(on_expired)) {
+			}
+
+			// Record activity, may be called from any thread
+			void touch() {
+				last_active_.store(clock_->load(std::memory_order_relaxed), std::memory_order_relaxed);
+			}
+
+			// The wheel drops a cancelled entry when its slot comes due
+			void cancel() {
+				cancelled_.store(true, std::memory_order_relaxed);
+			}
+
+			bool is_cancelled() const {
+				return cancelled_.load(std::memory_order_relaxed);
+			}
+		};
+		using entry_ptr = std::shared_ptr<entry>;
+
+	private:
+		static const size_t level0_bits = 8;
+		static const size_t level0_slots = size_t(1) << level0_bits;
+		static const size_t level1_slots = 64;
+
+		boost::asio::steady_timer timer_;
+		std::chrono::milliseconds tick_;
+		std::chrono::steady_clock::time_point start_;
+
+		// Ticks elapsed since start, read by entry::touch
+		std::shared_ptr<clock_type> now_;
+
+		std::mutex mutex_;
+		std::vector<entry_ptr> level0_[level0_slots];
+		std::vector<entry_ptr> level1_[level1_slots];
+		std::vector<entry_ptr> due_;
+		std::size_t size_;
+		bool is_running_;
+
+	public:
+		explicit TimingWheel(boost::asio::io_context& ioc,
+			std::chrono::milliseconds tick = std::chrono::seconds(1))
+			: timer_(ioc)
+			, tick_((std::max)(tick, std::chrono::milliseconds(1)))
+			, now_(std::make_shared<clock_type>(0))
+			, size_(0)
+			, is_running_(false)
+		{
+		}
+
+		~TimingWheel() {
+			stop();
+		}
+
+		void start() {
+			{
+				std::lock_guard<std::mutex> guard(mutex_);
+				if (is_running_) {
+					return;
+				}
+				is_running_ = true;
+			}
+			start_ = std::chrono::steady_clock::now();
+			do_tick();
+		}
+
+		// Pending entries are dropped without expiring
+		void stop() {
+			std::lock_guard<std::mutex> guard(mutex_);
+			is_running_ = false;
+			boost::system::error_code ec;
+			timer_.cancel(ec);
+			for (auto& slot : level0_) {
+				slot.clear();
+			}
+			for (auto& slot : level1_) {
+				slot.clear();
+			}
+			size_ = 0;
+		}
+
+		// on_expired runs on the io_context of the wheel, once, unless the
+		// entry is touched within every timeout or cancelled before.
+		entry_ptr add(std::chrono::milliseconds timeout, std::function<void()>&& on_expired) {
+			uint64_t ticks = std::max<uint64_t>(1, (timeout.count() + tick_.count() - 1) / tick_.count());
+			auto e = std::make_shared<entry>(now_, ticks, std::move(on_expired));
+
+			std::lock_guard<std::mutex> guard(mutex_);
+			schedule(e, e->last_active_.load(std::memory_order_relaxed) + ticks);
+			++size_;
+			return e;
+		}
+
+		std::chrono::milliseconds tick() const {
+			return tick_;
+		}
+
+		// Entries in the wheel, including cancelled ones not yet dropped
+		std::size_t size() {
+			std::lock_guard<std::mutex> guard(mutex_);
+			return size_;
+		}
+
+	private:
+		void do_tick() {
+			timer_.expires_at(start_ + tick_ * static_cast<int64_t>(now_->load() + 1));
+			timer_.async_wait(
+				[self = shared_from_this()](boost::system::error_code ec) {
+				if (ec) {
+					return;
+				}
+				self->on_tick();
+			});
+		}
+
+		void on_tick() {
+			// Catch up with every tick that passed, the timer may fire late
+			auto elapsed = std::chrono::steady_clock::now() - start_;
+			uint64_t target = static_cast<uint64_t>(elapsed / tick_);
+			{
+				std::lock_guard<std::mutex> guard(mutex_);
+				if (!is_running_) {
+					return;
+				}
+				while (now_->load(std::memory_order_relaxed) < target) {
+					advance();
+				}
+			}
+
+			// Outside the lock, a callback may add or cancel entries
+			for (auto& e : due_) {
+				auto on_expired = std::move(e->on_expired_);
+				if (on_expired) {
+					on_expired();
+				}
+			}
+			due_.clear();
+
+			do_tick();
+		}
+
+		void advance() {
+			uint64_t now = now_->load(std::memory_order_relaxed) + 1;
+			now_->store(now, std::memory_order_relaxed);
+
+			// Move the next level 1 slot down when level 0 completes a turn
+			if ((now & (level0_slots - 1)) == 0) {
+				std::vector<entry_ptr> slot;
+				slot.swap(level1_[(now >> level0_bits) % level1_slots]);
+				for (auto& e : slot) {
+					check(std::move(e), now);
+				}
+			}
+
+			std::vector<entry_ptr> slot;
+			slot.swap(level0_[now & (level0_slots - 1)]);
+			for (auto& e : slot) {
+				check(std::move(e), now);
+			}
+		}
+
+		void check(entry_ptr&& e, uint64_t now) {
+			if (e->is_cancelled()) {
+				--size_;
+				return;
+			}
+
+			uint64_t deadline = e->last_active_.load(std::memory_order_relaxed) + e->timeout_;
+			if (deadline <= now) {
+				e->cancel();
+				--size_;
+				due_.emplace_back(std::move(e));
+				return;
+			}
+			schedule(std::move(e), deadline);
+		}
+
+		void schedule(entry_ptr e, uint64_t deadline) {
+			uint64_t now = now_->load(std::memory_order_relaxed);
+			if (deadline <= now) {
+				deadline = now + 1;
+			}
+
+			if (deadline - now < level0_slots) {
+				level0_[deadline & (level0_slots - 1)].emplace_back(std::move(e));
+				return;
+			}
+
+			uint64_t turn = deadline >> level0_bits;
+			uint64_t last_turn = (now >> level0_bits) + level1_slots - 1;
+			level1_[(std::min)(turn, last_turn) % level1_slots].emplace_back(std::move(e));
+		}
+	};
+}
@@ -0,0 +1,488 @@
+#pragma once
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/strand.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "WSMessage.h"
+#include "WSReplay.h"
+
+namespace websocket {
+	// Sessions by topic, so a message reaches the sessions of one shop or
+	// terminal without visiting the others. Topics are spread over shards
+	// with a lock each. The members of a topic are grouped by lane of an
+	// io_context, a session keeps its lane for life, and each lane delivers
+	// in publish order on a strand of its own, so the threads of a shared
+	// io_context deliver in parallel and every session still gets a topic in
+	// order. Publish shares the member list with the delivery tasks; a
+	// subscribe changes it in place unless a task still holds it, so a burst
+	// of subscribes copies it once per publish at most. Ended sessions are
+	// dropped by unsubscribe, prune, or the publish that finds them.
+	//
+	// With replay enabled every topic also keeps its last messages, so a
+	// session that joins again can resume where it stopped, see join. The
+	// topics with a log are capped per shard; past it the log of a topic
+	// without live sessions, published to least recently, makes room.
+	template<typename session_type>
+	class TopicRegistry : public std::enable_shared_from_this<TopicRegistry<session_type>> {
+		// Sessions handed to one io thread task at most
+		static constexpr std::size_t sessions_per_task = 256;
+		static constexpr std::size_t shard_count = 64;
+
+		using strand_type = boost::asio::strand<boost::asio::io_context::executor_type>;
+
+		// Sessions of one lane, its tasks run in publish order on its strand
+		struct group {
+			boost::asio::io_context* context;
+			std::size_t lane;
+			strand_type strand;
+			std::vector<std::weak_ptr<session_type>> sessions;
+		};
+		using members = std::vector<group>;
+
+		struct channel {
+			std::shared_ptr<members> current;
+			// Every session of current, so subscribe finds one without a scan
+			std::unordered_map<const session_type*, std::weak_ptr<session_type>> index;
+			std::unique_ptr<ReplayLog> log;
+			std::uint64_t last_publish = 0;	// tick of the shard
+		};
+
+		struct shard {
+			std::mutex mutex;
+			std::unordered_map<std::string, channel> topics;
+			std::size_t logs = 0;			// topics with a log
+			std::uint64_t ticks = 0;		// publishes
+			std::uint64_t next_evict = 0;	// tick of the next try once none could go
+			// New logs continue from it, above every sequence of an evicted log,
+			// so a session resuming an evicted topic is never matched by accident
+			std::uint64_t start_sequence = 0;
+		};
+		std::array<shard, shard_count> shards_;
+
+		// Messages kept per topic, zero disables replay
+		std::size_t replay_capacity_;
+		std::size_t logs_per_shard_;
+
+		// Strands of the lanes of every io_context, the same for every topic
+		// and kept until clear, so a lane never changes strand. Locked after
+		// a shard.
+		std::size_t lanes_;
+		std::mutex strands_mutex_;
+		std::unordered_map<boost::asio::io_context*, std::vector<strand_type>> strands_;
+
+	public:
+		TopicRegistry()
+			: replay_capacity_(0)
+			, logs_per_shard_(16384 / shard_count)
+			, lanes_(1) {
+		}
+
+		// Lanes per io_context, the threads that run it. Set before the
+		// first subscribe.
+		void set_lanes(std::size_t lanes) {
+			lanes_ = (std::max)(std::size_t(1), lanes);
+		}
+
+		// Set before the first subscribe or publish
+		void set_replay(std::size_t capacity) {
+			replay_capacity_ = capacity;
+		}
+
+		std::size_t get_replay() const {
+			return replay_capacity_;
+		}
+
+		// Topics with a log at most, 16384 by default. Set before the first
+		// subscribe or publish.
+		void set_replay_topics(std::size_t count) {
+			logs_per_shard_ = (std::max)(std::size_t(1), (count + shard_count - 1) / shard_count);
+		}
+
+		// False if the session is subscribed already
+		bool subscribe(const std::string& topic, const std::shared_ptr<session_type>& session) {
+			shard& s = shard_of(topic);
+			std::lock_guard<std::mutex> guard(s.mutex);
+			return add(make_channel(s, topic), session);
+		}
+
+		// False if the session was not subscribed
+		bool unsubscribe(const std::string& topic, const std::shared_ptr<session_type>& session) {
+			shard& s = shard_of(topic);
+			std::lock_guard<std::mutex> guard(s.mutex);
+			auto itor = s.topics.find(topic);
+			if (itor == s.topics.end()) {
+				return false;
+			}
+
+			channel& c = itor->second;
+			auto member = c.index.find(session.get());
+			if (member == c.index.end() || !is_same(member->second, session)) {
+				return false;
+			}
+			c.index.erase(member);
+
+			// Only the group of its lane can hold it
+			boost::asio::io_context* context = &session->get_io_context();
+			std::size_t lane = lane_of(session.get());
+			for (auto& g : writable(c)) {
+				if (g.context == context && g.lane == lane) {
+					auto found = std::find_if(g.sessions.begin(), g.sessions.end(),
+						[&](const std::weak_ptr<session_type>& other) { return is_same(other, session); });
+					if (found != g.sessions.end()) {
+						g.sessions.erase(found);
+					}
+					break;
+				}
+			}
+			drop_empty(s, itor);
+			return true;
+		}
+
+		// Subscribe session to the channel of every point. With the shards of
+		// all of them locked, each point gets the messages its session missed
+		// and on_locked(points) runs, so what it queues on the session comes
+		// before any message published later.
+		template<typename OnLocked>
+		void join(const std::shared_ptr<session_type>& session, std::vector<replay_point>& points, OnLocked&& on_locked) {
+			// Locked in shard order, so joins never wait on each other in a cycle
+			std::vector<shard*> locked;
+			locked.reserve(points.size());
+			for (const auto& point : points) {
+				locked.push_back(&shard_of(point.channel));
+			}
+			std::sort(locked.begin(), locked.end());
+			locked.erase(std::unique(locked.begin(), locked.end()), locked.end());
+
+			std::vector<std::unique_lock<std::mutex>> guards;
+			guards.reserve(locked.size());
+			for (auto s : locked) {
+				guards.emplace_back(s->mutex);
+			}
+
+			for (auto& point : points) {
+				channel& c = make_channel(shard_of(point.channel), point.channel);
+				if (c.log) {
+					c.log->replay(point);
+				}
+				else {
+					// Without replay, or past the cap, there is nothing to resume from
+					point.status = point.resume && replay_capacity_ > 0 ?
+						replay_status::snapshot_required : replay_status::started;
+					point.missed.clear();
+					point.sequence = 0;
+				}
+				add(c, session);
+			}
+			on_locked(points);
+		}
+
+		// Queue message to every session of topic, each io thread sends to its
+		// own sessions. Returns the sessions subscribed, some may have ended.
+		std::size_t publish(const std::string& topic, const write_message& message) {
+			shard& s = shard_of(topic);
+			std::lock_guard<std::mutex> guard(s.mutex);
+
+			// A replayed topic keeps its log while nobody is subscribed
+			auto itor = s.topics.find(topic);
+			if (itor == s.topics.end()) {
+				if (replay_capacity_ == 0) {
+					return 0;
+				}
+				itor = s.topics.emplace(topic, channel()).first;
+			}
+			channel& c = itor->second;
+			c.last_publish = ++s.ticks;
+			if (!c.log && replay_capacity_ > 0) {
+				make_log(s, c);
+			}
+			if (c.log) {
+				c.log->append(message);
+			}
+			if (!c.current) {
+				if (!c.log) {
+					s.topics.erase(itor);
+				}
+				return 0;
+			}
+
+			// Posted locked, so the tasks of one group keep the sequence order
+			std::size_t count = 0;
+			std::weak_ptr<TopicRegistry> registry = this->shared_from_this();
+			std::shared_ptr<const members> current = c.current;
+			for (std::size_t g = 0; g < current->size(); ++g) {
+				const group& target = (*current)[g];
+				count += target.sessions.size();
+				for (std::size_t first = 0; first < target.sessions.size(); first += sessions_per_task) {
+					boost::asio::post(target.strand,
+						[registry, current, g, first, topic, message]() {
+						deliver(registry, *current, g, first, topic, message);
+					});
+				}
+			}
+			return count;
+		}
+
+		// Sequence of the last message published to topic, zero without replay
+		std::uint64_t last_sequence(const std::string& topic) {
+			shard& s = shard_of(topic);
+			std::lock_guard<std::mutex> guard(s.mutex);
+			auto itor = s.topics.find(topic);
+			if (itor == s.topics.end() || !itor->second.log) {
+				return 0;
+			}
+			return itor->second.log->last_sequence();
+		}
+
+		std::size_t size(const std::string& topic) {
+			shard& s = shard_of(topic);
+			std::lock_guard<std::mutex> guard(s.mutex);
+			auto itor = s.topics.find(topic);
+			if (itor == s.topics.end() || !itor->second.current) {
+				return 0;
+			}
+			std::size_t count = 0;
+			for (const auto& g : *itor->second.current) {
+				count += g.sessions.size();
+			}
+			return count;
+		}
+
+		std::size_t topic_count() {
+			std::size_t count = 0;
+			for (auto& s : shards_) {
+				std::lock_guard<std::mutex> guard(s.mutex);
+				count += s.topics.size();
+			}
+			return count;
+		}
+
+		// Drop ended sessions and empty topics, one shard at a time
+		void prune() {
+			for (auto& s : shards_) {
+				std::lock_guard<std::mutex> guard(s.mutex);
+				for (auto itor = s.topics.begin(); itor != s.topics.end();) {
+					auto current = itor++;
+					drop_ended(s, current);
+				}
+			}
+		}
+
+		// Also forgets the replay logs and the strands, before the
+		// io_contexts go
+		void clear() {
+			for (auto& s : shards_) {
+				std::lock_guard<std::mutex> guard(s.mutex);
+				s.topics.clear();
+				s.logs = 0;
+				s.next_evict = 0;
+			}
+			std::lock_guard<std::mutex> guard(strands_mutex_);
+			strands_.clear();
+		}
+
+	private:
+		shard& shard_of(const std::string& topic) {
+			return shards_[std::hash<std::string>()(topic) % shard_count];
+		}
+
+		// Called with the shard locked
+		channel& make_channel(shard& s, const std::string& topic) {
+			channel& c = s.topics[topic];
+			if (!c.log && replay_capacity_ > 0) {
+				make_log(s, c);
+			}
+			return c;
+		}
+
+		// Called with the shard locked. A shard with its share of logs first
+		// evicts one, the topic stays without a log if none can go.
+		void make_log(shard& s, channel& c) {
+			if (s.logs >= logs_per_shard_ && !evict_log(s)) {
+				return;
+			}
+			c.log = std::make_unique<ReplayLog>(replay_capacity_, s.start_sequence);
+			++s.logs;
+		}
+
+		// Called with the shard locked. Drops the log of the topic without
+		// live sessions published to least recently. When every logged topic
+		// has sessions the next try waits for as many publishes as the shard
+		// holds logs, so the scans cost a constant per publish.
+		bool evict_log(shard& s) {
+			if (s.ticks < s.next_evict) {
+				return false;
+			}
+			auto victim = s.topics.end();
+			for (auto itor = s.topics.begin(); itor != s.topics.end(); ++itor) {
+				const channel& c = itor->second;
+				if (c.log && !has_live(c) && (victim == s.topics.end() || c.last_publish < victim->second.last_publish)) {
+					victim = itor;
+				}
+			}
+			if (victim == s.topics.end()) {
+				s.next_evict = s.ticks + logs_per_shard_;
+				return false;
+			}
+
+			s.start_sequence = (std::max)(s.start_sequence, victim->second.log->last_sequence() + 1);
+			victim->second.log.reset();
+			--s.logs;
+			drop_ended(s, victim);
+			return true;
+		}
+
+		static bool has_live(const channel& c) {
+			return c.current && std::any_of(c.current->begin(), c.current->end(), [](const group& g) {
+				return std::any_of(g.sessions.begin(), g.sessions.end(),
+					[](const std::weak_ptr<session_type>& member) { return !member.expired(); });
+			});
+		}
+
+		// Called with the shard locked
+		bool add(channel& c, const std::shared_ptr<session_type>& session) {
+			// An entry that is not session belongs to an ended session whose
+			// memory was reused, it is replaced
+			auto& member = c.index[session.get()];
+			if (is_same(member, session)) {
+				return false;
+			}
+			member = session;
+
+			boost::asio::io_context* context = &session->get_io_context();
+			std::size_t lane = lane_of(session.get());
+			members& next = writable(c);
+			auto itor = std::find_if(next.begin(), next.end(),
+				[&](const group& g) { return g.context == context && g.lane == lane; });
+			if (itor == next.end()) {
+				next.push_back(group{ context, lane, strand_of(context, lane), {} });
+				itor = std::prev(next.end());
+			}
+			itor->sessions.emplace_back(session);
+			return true;
+		}
+
+		// Lane of session for its whole life, its messages stay in order
+		std::size_t lane_of(const session_type* session) const {
+			// Allocations are aligned, the multiply mixes every bit into the high ones
+			auto key = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(session));
+			return static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ull) >> 40) % lanes_;
+		}
+
+		strand_type strand_of(boost::asio::io_context* context, std::size_t lane) {
+			std::lock_guard<std::mutex> guard(strands_mutex_);
+			auto& strands = strands_[context];
+			while (strands.size() <= lane) {
+				strands.push_back(boost::asio::make_strand(*context));
+			}
+			return strands[lane];
+		}
+
+		static bool is_same(const std::weak_ptr<session_type>& member, const std::shared_ptr<session_type>& session) {
+			return !member.owner_before(session) && !session.owner_before(member);
+		}
+
+		// Called with the shard locked. Members to change, copied when a
+		// delivery task still reads them.
+		static members& writable(channel& c) {
+			if (!c.current) {
+				c.current = std::make_shared<members>();
+			}
+			else if (c.current.use_count() > 1) {
+				c.current = std::make_shared<members>(*c.current);
+			}
+			else {
+				// The last task released its copy, its reads happen before the change
+				std::atomic_thread_fence(std::memory_order_acquire);
+			}
+			return *c.current;
+		}
+
+		// Called with the shard locked
+		template<typename Iterator>
+		static void drop_ended(shard& s, Iterator itor) {
+			channel& c = itor->second;
+			if (!c.current) {
+				drop_empty(s, itor);
+				return;
+			}
+			auto is_ended = [](const std::weak_ptr<session_type>& member) { return member.expired(); };
+			bool has_ended = std::any_of(c.current->begin(), c.current->end(),
+				[&](const group& g) { return std::any_of(g.sessions.begin(), g.sessions.end(), is_ended); });
+			if (has_ended) {
+				for (auto member = c.index.begin(); member != c.index.end();) {
+					member = is_ended(member->second) ? c.index.erase(member) : std::next(member);
+				}
+				for (auto& g : writable(c)) {
+					g.sessions.erase(std::remove_if(g.sessions.begin(), g.sessions.end(), is_ended), g.sessions.end());
+				}
+			}
+			drop_empty(s, itor);
+		}
+
+		// Called with the shard locked. Forgets empty groups, and the topic
+		// once it has neither members nor a log.
+		template<typename Iterator>
+		static void drop_empty(shard& s, Iterator itor) {
+			channel& c = itor->second;
+			if (c.current) {
+				bool has_empty = std::any_of(c.current->begin(), c.current->end(),
+					[](const group& g) { return g.sessions.empty(); });
+				if (has_empty) {
+					members& next = writable(c);
+					next.erase(std::remove_if(next.begin(), next.end(),
+						[](const group& g) { return g.sessions.empty(); }), next.end());
+				}
+				if (c.current->empty()) {
+					c.current.reset();
+				}
+			}
+			if (!c.current && !c.log) {
+				s.topics.erase(itor);
+			}
+		}
+
+		// On the strand of the group
+		static void deliver(const std::weak_ptr<TopicRegistry>& registry, const members& current,
+			std::size_t g, std::size_t first, const std::string& topic, const write_message& message) {
+			const auto& sessions = current[g].sessions;
+			std::size_t last = (std::min)(sessions.size(), first + sessions_per_task);
+			bool has_ended = false;
+			for (std::size_t i = first; i < last; ++i) {
+				if (auto session = sessions[i].lock()) {
+					session->send(write_message(message));
+				}
+				else {
+					has_ended = true;
+				}
+			}
+
+			if (has_ended) {
+				if (auto self = registry.lock()) {
+					self->drop_ended(topic, current);
+				}
+			}
+		}
+
+		// Unless the topic changed since current was published. The task
+		// still holds current, so it was not changed in place.
+		void drop_ended(const std::string& topic, const members& current) {
+			shard& s = shard_of(topic);
+			std::lock_guard<std::mutex> guard(s.mutex);
+			auto itor = s.topics.find(topic);
+			if (itor != s.topics.end() && itor->second.current.get() == &current) {
+				drop_ended(s, itor);
+			}
+		}
+	};
+}
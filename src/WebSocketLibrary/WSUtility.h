@@ -1,6 +1,7 @@
 #pragma once
 #include <iostream>
 #include <string>
+#include <string_view>
 
 #include <mutex>
 #include <shared_mutex>
@@ -9,7 +10,10 @@
 #include <ctime>
 #include <locale>
 
+#include <algorithm>
+#include <atomic>
 #include <list>
+#include <memory>
 #include <vector>
 #include <functional>
 #include <sstream>
@@ -21,6 +25,9 @@
 #include <system_error>
 
 #if defined(WIN32) || defined(WIN64)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
 #include <Windows.h>
 #endif
 
@@ -28,192 +35,9 @@
 #define  _CRT_SECURE_NO_WARNINGS
 #endif
 
-namespace websocket {
-	// Filesystem
-#if defined(WIN32) || defined(WIN64)
-	static std::wstring GetCurrentPath() {
-		wchar_t buffer[MAX_PATH];
-		size_t path_len = GetModuleFileNameW(NULL, buffer, MAX_PATH);
-		if (path_len== 0) {
-			return L"";
-		}
-		std::wstring ws(buffer, path_len);
-		if (auto pos = ws.rfind(L"\\")) {
-			ws = ws.substr(0, pos + 1);
-		}
-		return ws;
-	}
-
-	static bool IsDirectoryExists(const std::wstring& path) {
-		return std::filesystem::exists(path);
-	}
-
-	static bool CreateDirectory(const std::wstring& path) {
-		if (IsDirectoryExists(path)) {
-			return true;
-		}
-
-		std::error_code ec;
-		if (std::filesystem::create_directory(path, ec) && ec) {
-			return true;
-		}
-
-		if (ec) {
-			std::cout << "Create director failed, error=" << ec.message() << std::endl;
-		}
-
-		return false;
-	}
-
-	static std::wstring GetLogFilePath(bool is_debug = false) {
-		// Create log folder and file
-		auto path = GetCurrentPath();
-		path += is_debug ? L"\\debug_log\\" : L"\\log\\";
-
-		if (IsDirectoryExists(path) || (!is_debug && CreateDirectory(path))) {
-			return path + L"WebSocket.log";
-		}
-		else {
-			return L"";
-		}
-	}
-
-#else
-	static std::string GetCurrentPath() {
-		return std::filesystem::current_path().string();
-	}
-
-	static bool IsDirectoryExists(const std::string& path) {
-		return std::filesystem::exists(path);
-	}
-
-	static bool CreateDirectory(const std::string& path) {
-		if (IsDirectoryExists(path)) {
-			return true;
-		}
-
-		std::error_code ec;
-		if (std::filesystem::create_directory(path, ec) && ec) {
-			return true;
-		}
-
-		if (ec) {
-			std::cout << "Create director failed, error=" << ec.message() << std::endl;
-		}
-
-		return false;
-	}
-
-	static std::string GetLogFilePath(bool is_debug = false) {
-		// Create log folder and file
-		auto path = GetCurrentPath();
-		path += is_debug ? "\\debug_log\\" : "\\log\\";
-
-		if (IsDirectoryExists(path) || (!is_debug && CreateDirectory(path))) {
-			return path + "WebSocket.log";
-		}
-		else {
-			return "";
-		}
-	}
-#endif
-
-	// Time 
-	static std::string get_now() {
-		std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-		std::string s(24, '\0');
-		std::strftime(&s[0], s.size(), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
-
-		return s;
-	}
-
-	static void writeLog(const std::string& log, bool is_debug = false) {
-		std::ofstream ofs;
-		ofs.open(GetLogFilePath(is_debug), std::ios::binary | std::ios::app);
-		if (ofs&& ofs.is_open()) {
-			ofs.write(log.c_str(), log.size());
-		}
-		ofs.close();
-	}
-
-	static uint64_t get_now_epoch() {
-		return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-	}
-
-	// Logger
-	template<typename T>
-	void exception_log(char const* category, T ec)
-	{
-		std::stringstream ss;
-		ss << get_now() << category << ": " << ec.message() << std::endl;
-		ss.flush();
-
-		// output console
-		std::cerr << ss.str();
-		// output file
-		writeLog(ss.str());
-	}
-
-	static void log(const std::string& content) {
-		std::stringstream ss;
-		ss << get_now() << content << std::endl;
-		ss.flush();
-
-		// output console
-		std::cout << ss.str();
-		// output file
-		writeLog(ss.str());
-	}
-
-	static void log_debug(const std::string& content) {
-		std::stringstream ss;
-		ss << get_now() << content << std::endl;
-		ss.flush();
-
-		// output console
-		std::cout << ss.str();
-		// output file
-		writeLog(ss.str(), true);
-	}
-	/*
-	// Variadic functions
-	void log(const char* fmt, ...) {
-		char buf[1024];
-		va_list args;
-		va_start(args, fmt);
-		vsnprintf(buf, 1024, fmt, args);
-		va_end(args);
-
-		log(std::string(buf, 1024));
-	}
-	*/
-	static void templateLogImpl(std::stringstream& os, const char* format)
-	{
-		os << format;
-	}
-
-	template<typename T, typename... Targs>
-	static void templateLogImpl(std::stringstream& os, const char* fmt, T value, Targs... Fargs) {
-		for (; *fmt != '\0'; fmt++) {
-			if (*fmt == '%') {
-				os << value;
-				templateLogImpl(os, fmt + 2, Fargs...);
-				return;
-			}
-			os << *fmt;
-		}
-	}
-	// Wrapper of Parameter pack template
-	// Parameter pack template
-	template<typename T, typename... Targs>
-	void log(const char* fmt, T value, Targs... Fargs)
-	{
-		std::stringstream ss;
-		templateLogImpl(ss, fmt, value, Fargs...);
-
-		log(ss.str());
-	}
+#include "WSLogger.h"
 
+namespace websocket {
 	// Container
 	template<typename T>
 	class LockQueue {
@@ -279,46 +103,172 @@ namespace websocket {
 	};
 
 	template<typename T> using CallbackHandler = std::function<void(const T&)>;
+
+	// Subscribers are copied on write. Readers keep the list they last saw
+	// per thread and only check an atomic version before each broadcast,
+	// so broadcast takes no lock, writes no shared memory and copies no
+	// callback. Broadcasts that began before unsubscribe returned may still
+	// call the callback, later ones do not. It is destroyed once every
+	// thread that broadcast on the channel broadcast again, or exited.
 	template<typename T>
 	class MessageChannel {
-		std::shared_mutex  mutex_;
-		std::vector<T> subscribers_;
 	public:
-		MessageChannel() {}
+		// Returned by subscribe, zero is never used
+		using handle = uint64_t;
+
+	private:
+		struct subscriber {
+			handle id;
+			T callback;
+		};
+		using snapshot = std::vector<subscriber>;
+
+		// List a thread last read, with those replaced during a nested broadcast
+		struct cached_snapshot {
+			uint64_t channel;
+			uint64_t version;
+			std::weak_ptr<void> alive;
+			std::shared_ptr<const snapshot> subscribers;
+			std::vector<std::shared_ptr<const snapshot>> retired;
+			int depth;
+		};
+
+		const uint64_t id_;
+		std::shared_ptr<void> alive_;
+
+		std::mutex mutex_;
+		std::shared_ptr<const snapshot> subscribers_;
+		std::atomic<uint64_t> version_;
+		handle next_handle_;
+
+	public:
+		MessageChannel()
+			: id_(next_channel_id())
+			, alive_(std::make_shared<char>(0))
+			, subscribers_(std::make_shared<snapshot>())
+			, version_(0)
+			, next_handle_(1) {
+		}
+
 		virtual ~MessageChannel() {
-			std::lock_guard<std::shared_mutex> guard(mutex_);
-			subscribers_.clear();
+			clear();
 		}
 
-		void subscribe(const T& callback) {
-			std::lock_guard<std::shared_mutex> guard(mutex_);
-			subscribers_.emplace_back(callback);
+		handle subscribe(const T& callback) {
+			return subscribe(T(callback));
 		}
 
-		void subscribe(T&& callback) {
-			std::lock_guard<std::shared_mutex> guard(mutex_);
-			subscribers_.emplace_back(std::move(callback));
+		handle subscribe(T&& callback) {
+			std::lock_guard<std::mutex> guard(mutex_);
+			auto subscribers = std::make_shared<snapshot>(*subscribers_);
+			handle id = next_handle_++;
+			subscribers->push_back(subscriber{ id, std::move(callback) });
+			publish(std::move(subscribers));
+			return id;
 		}
 
-		template<typename T2>
-		void broadcast(const T2& data) {
-			std::shared_lock<std::shared_mutex> guard(mutex_);
-			for (auto cb : subscribers_) {
-				if (cb) {
-					cb(data);
+		// False if id is not subscribed
+		bool unsubscribe(handle id) {
+			std::lock_guard<std::mutex> guard(mutex_);
+			auto itor = std::find_if(subscribers_->begin(), subscribers_->end(),
+				[id](const subscriber& s) { return s.id == id; });
+			if (itor == subscribers_->end()) {
+				return false;
+			}
+			auto subscribers = std::make_shared<snapshot>();
+			subscribers->reserve(subscribers_->size() - 1);
+			for (const auto& s : *subscribers_) {
+				if (s.id != id) {
+					subscribers->push_back(s);
 				}
 			}
+			publish(std::move(subscribers));
+			return true;
+		}
+
+		void clear() {
+			std::lock_guard<std::mutex> guard(mutex_);
+			publish(std::make_shared<snapshot>());
+		}
+
+		std::size_t size() {
+			std::lock_guard<std::mutex> guard(mutex_);
+			return subscribers_->size();
 		}
 
 		template<typename T2>
 		void broadcast(T2&& data) {
-			std::shared_lock<std::shared_mutex> guard(mutex_);
-			for (auto cb : subscribers_) {
-				if (cb) {
-					cb(data);
+			cached_snapshot& cached = acquire();
+
+			// Callbacks may subscribe or broadcast again, the list stays
+			// alive until the outermost broadcast of this thread returns
+			struct depth_guard {
+				cached_snapshot& cached;
+				explicit depth_guard(cached_snapshot& c) : cached(c) { ++cached.depth; }
+				~depth_guard() {
+					if (--cached.depth == 0) {
+						cached.retired.clear();
+					}
+				}
+			} guard(cached);
+
+			const snapshot& subscribers = *cached.subscribers;
+			for (const auto& s : subscribers) {
+				if (s.callback) {
+					s.callback(data);
 				}
 			}
 		}
+
+	private:
+		static uint64_t next_channel_id() {
+			static std::atomic<uint64_t> next(1);
+			return next.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// Lists cached by the calling thread, one per channel it broadcast on
+		static std::vector<std::unique_ptr<cached_snapshot>>& thread_cache() {
+			thread_local std::vector<std::unique_ptr<cached_snapshot>> cache;
+			return cache;
+		}
+
+		// Called with mutex_ held
+		void publish(std::shared_ptr<const snapshot> subscribers) {
+			subscribers_ = std::move(subscribers);
+			version_.fetch_add(1, std::memory_order_release);
+		}
+
+		cached_snapshot& acquire() {
+			auto& cache = thread_cache();
+			uint64_t version = version_.load(std::memory_order_acquire);
+			for (auto& cached : cache) {
+				if (cached->channel == id_) {
+					if (cached->version != version) {
+						refresh(*cached);
+					}
+					return *cached;
+				}
+			}
+
+			// First broadcast of this thread, drop the lists of deleted channels
+			cache.erase(std::remove_if(cache.begin(), cache.end(),
+				[](const std::unique_ptr<cached_snapshot>& cached) {
+				return cached->depth == 0 && cached->alive.expired();
+			}), cache.end());
+
+			cache.emplace_back(new cached_snapshot{ id_, 0, alive_, nullptr, {}, 0 });
+			refresh(*cache.back());
+			return *cache.back();
+		}
+
+		void refresh(cached_snapshot& cached) {
+			if (cached.depth > 0 && cached.subscribers) {
+				cached.retired.push_back(std::move(cached.subscribers));
+			}
+			std::lock_guard<std::mutex> guard(mutex_);
+			cached.subscribers = subscribers_;
+			cached.version = version_.load(std::memory_order_relaxed);
+		}
 	};
 	using Channel = MessageChannel<CallbackHandler<std::string>>;
 
@@ -0,0 +1,80 @@
+#pragma once
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+
+#include "WSMetrics.h"
+#include "WSUtility.h"
+
+namespace websocket {
+	// Fixed threads for callbacks too slow for the io threads, such as
+	// validating a large message, so one of them does not delay every other
+	// session of its io thread. The queue is bounded: once max_queued jobs
+	// wait, run refuses and the caller runs the job itself, which slows its
+	// io thread down instead of growing the queue.
+	class WorkerPool {
+		std::unique_ptr<boost::asio::io_context> ioc_;
+		std::unique_ptr<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> work_;
+		ThreadGroup threads_;
+		std::size_t max_queued_;
+		std::shared_ptr<worker_metrics> metrics_;
+
+	public:
+		// max_queued of zero never refuses a job
+		explicit WorkerPool(std::size_t thread_count, std::size_t max_queued = 0,
+			std::shared_ptr<worker_metrics> metrics = std::make_shared<worker_metrics>())
+			: ioc_(std::make_unique<boost::asio::io_context>(static_cast<int>(thread_count)))
+			, max_queued_(max_queued)
+			, metrics_(metrics ? std::move(metrics) : std::make_shared<worker_metrics>())
+		{
+			work_ = std::make_unique<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>>(
+				boost::asio::make_work_guard(*ioc_));
+			auto context = ioc_.get();
+			threads_.create_thread_count([context]() { context->run(); }, std::max<std::size_t>(1, thread_count));
+		}
+
+		~WorkerPool() {
+			stop();
+		}
+
+		// Drops queued jobs, call before the io_contexts of the sessions
+		// they hold are destroyed
+		void stop() {
+			if (!ioc_) {
+				return;
+			}
+			work_.reset();
+			ioc_->stop();
+			threads_.join_and_clear_all();
+			ioc_.reset();
+		}
+
+		// Queue job for a worker, false if the queue is full and the caller
+		// should run it. The bound is approximate under concurrent callers.
+		bool run(std::function<void()>&& job) {
+			if (max_queued_ != 0 && metrics_->queued.value() >= static_cast<int64_t>(max_queued_)) {
+				metrics_->inline_runs.add();
+				return false;
+			}
+
+			metrics_->queued.add();
+			auto queued_at = std::chrono::steady_clock::now();
+			boost::asio::post(*ioc_, [metrics = metrics_, queued_at, job = std::move(job)]() {
+				metrics->queued.sub();
+				metrics->jobs.add();
+				metrics->wait_ns.add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now() - queued_at).count()));
+				job();
+			});
+			return true;
+		}
+
+		std::shared_ptr<worker_metrics> get_metrics() const {
+			return metrics_;
+		}
+	};
+}
@@ -0,0 +1,130 @@
+// Test of the watermark handler. Every message crosses a one byte high
+// watermark and the handler broadcasts a notice, while join sends its
+// response and replay under sessions_mutex_ and publish sends under a
+// shard lock. The handler must run later on the session strand, or the
+// broadcast waits on a lock its own thread holds and a watchdog fails
+// the test.
+#include "WSServer.h"
+
+#include <boost/beast/websocket.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+namespace {
+	namespace ws = boost::beast::websocket;
+	using stream = ws::stream<boost::asio::ip::tcp::socket>;
+
+	const unsigned short port = 18095;
+	const std::string notice = "slow consumer";
+
+	std::unique_ptr<stream> join(boost::asio::io_context& ioc, const std::string& key, std::string& response) {
+		boost::asio::ip::tcp::socket socket(ioc);
+		socket.connect({ boost::asio::ip::make_address("127.0.0.1"), port });
+		auto client = std::make_unique<stream>(std::move(socket));
+		client->handshake("127.0.0.1", "/");
+		client->write(boost::asio::buffer(key));
+		boost::beast::flat_buffer buffer;
+		client->read(buffer);
+		response = boost::beast::buffers_to_string(buffer.data());
+		return client;
+	}
+
+	// Next message that is not a notice of the handler
+	std::string next(stream& client, int& notices) {
+		for (;;) {
+			boost::beast::flat_buffer buffer;
+			client.read(buffer);
+			std::string message = boost::beast::buffers_to_string(buffer.data());
+			if (message != notice) {
+				return message;
+			}
+			++notices;
+		}
+	}
+}
+
+int main() {
+	// Unbuffered, the watchdog exits without flushing
+	setvbuf(stdout, nullptr, _IONBF, 0);
+	websocket::set_log_level(websocket::log_level::error);
+
+	std::thread([] {
+		std::this_thread::sleep_for(std::chrono::seconds(20));
+		printf("watermark handler deadlocked, FAILED\n");
+		std::_Exit(1);
+	}).detach();
+
+	websocket::KeyServer server;
+	server.set_listener("127.0.0.1", port);
+	server.set_key("K");
+	server.set_replay(8);
+
+	websocket::write_queue_limits limits;
+	limits.high_watermark = 1;
+	server.set_write_queue_limits(limits);
+
+	// A notice crosses the watermark too, so only the first few broadcast
+	const std::thread::id main_thread = std::this_thread::get_id();
+	std::atomic<int> above(0);
+	std::atomic<int> below(0);
+	std::atomic<int> on_caller(0);
+	server.set_watermark_handler([&](bool is_above, std::shared_ptr<websocket::tcp_session>) {
+		if (std::this_thread::get_id() == main_thread) {
+			++on_caller;
+		}
+		if (!is_above) {
+			++below;
+			return;
+		}
+		if (above++ < 4) {
+			server.broadcast(std::string(notice));
+		}
+	});
+	if (!server.start(2)) {
+		printf("start FAILED\n");
+		return 1;
+	}
+
+	bool ok = true;
+	int notices = 0;
+	try {
+		boost::asio::io_context ioc;
+		std::string response;
+		auto first = join(ioc, R"({"key":"K","topics":["shop.1"]})", response);
+		std::size_t at = response.find("\"epoch\":");
+		std::string epoch = at == std::string::npos ? "0" :
+			response.substr(at + 8, response.find_first_of(",}", at) - at - 8);
+
+		for (int i = 1; i <= 3; ++i) {
+			server.publish("shop.1", "p" + std::to_string(i));
+		}
+		for (int i = 1; i <= 3; ++i) {
+			ok = next(*first, notices) == "p" + std::to_string(i) && ok;
+		}
+		first->close(ws::close_code::normal);
+
+		// Missed messages are sent by join, under both locks
+		server.publish("shop.1", std::string("p4"));
+		server.publish("shop.1", std::string("p5"));
+		auto second = join(ioc, R"({"key":"K","topics":["shop.1"],"resume":{"epoch":)" + epoch +
+			R"(,"topics":{"shop.1":"3"}}})", response);
+		ok = next(*second, notices) == "p4" && ok;
+		ok = next(*second, notices) == "p5" && ok;
+		second->close(ws::close_code::normal);
+	}
+	catch (const std::exception& e) {
+		printf("client  %s\n", e.what());
+		ok = false;
+	}
+	server.stop();
+
+	ok = ok && above > 0 && on_caller == 0;
+	printf("watermark above=%d below=%d notices=%d on caller=%d, %s\n",
+		above.load(), below.load(), notices, on_caller.load(), ok ? "passed" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -1,9 +1,9 @@
 #pragma once
 #include "WSServerExport.h"
+#include <WebSocketLibrary/WSJson.h>
 #include <WebSocketLibrary/WSListener.h>
-
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/json_parser.hpp>
+#include <WebSocketLibrary/WSTopic.h>
+#include <WebSocketLibrary/WSWorkerPool.h>
 
 namespace websocket {
 
@@ -24,8 +24,8 @@ namespace websocket {
 		|	 Echo Data		|				|
 		|<------------------|				|
 		|					|  Transaction	|
-		| Send Keep-alive	|				|
-		|------------------>|				|
+		|	 Ping / Pong	|				|
+		|<----------------->|				|
 		|		...			|				|
 		|		...			|				|
 		|					|_______________|
@@ -46,13 +46,28 @@ namespace websocket {
 
 	template<typename server_session_type, typename base_session_type>
 	class WSServerKey {
-		std::shared_ptr<Listener<server_session_type, base_session_type>> listener_;
-		std::unique_ptr<boost::asio::io_context> io_context_;
+		using listener_type = Listener<server_session_type, base_session_type>;
+
+		// One of each in the shared model, one per thread in thread per core mode
+		std::vector<std::shared_ptr<listener_type>> listeners_;
+		// Guards listeners_, reload_certificate may run on any thread
+		std::mutex listeners_mutex_;
+		std::vector<std::unique_ptr<boost::asio::io_context>> io_contexts_;
 		boost::asio::ip::tcp::endpoint endpoint_;
+		bool thread_per_core_;
 
 		ThreadGroup thread_group_;
 		
+		// Guards ssl_config_ and ticket_keys_, a reload may run meanwhile
+		std::mutex ssl_mutex_;
 		std::unique_ptr<ssl_config> ssl_config_;
+		std::shared_ptr<TicketKeyRing> ticket_keys_;
+
+		// Reload the certificate when its files change, see set_certificate_watch
+		std::chrono::seconds certificate_watch_interval_;
+		std::unique_ptr<boost::asio::steady_timer> certificate_watch_timer_;
+		std::pair<std::filesystem::file_time_type, std::filesystem::file_time_type> certificate_times_;
+
 		std::shared_ptr<Channel> channel_;
 
 		std::string key_;
@@ -67,14 +82,80 @@ namespace websocket {
 		void* on_leave_object_;
 		OnValidate on_validate_;
 		void* on_validate_object_;
+
+		bool write_batching_;
+		std::size_t max_batch_bytes_;
+
+		write_queue_limits write_limits_;
+		WatermarkHandler<base_session_type> watermark_handler_;
+
+		std::chrono::milliseconds idle_timeout_;
+		std::chrono::milliseconds ping_interval_;
+
+		// One control shared by every listener so the caps are global
+		admission_limits admission_limits_;
+		std::shared_ptr<AdmissionControl> admission_;
+
+		socket_options socket_options_;
+
+		tls_resumption_options tls_resumption_;
+		std::shared_ptr<handshake_metrics> handshake_metrics_;
+
+		// TLS handshakes run on their own threads when handshake_threads_ is set
+		std::size_t handshake_threads_;
+		std::size_t max_pending_handshakes_;
+		std::shared_ptr<HandshakePool> handshake_pool_;
+
+		// Move TLS records into the kernel after the handshake
+		bool ktls_;
+
+		// OnValidate and OnData run on their own threads when validation_threads_ is set
+		std::size_t validation_threads_;
+		std::size_t max_queued_validations_;
+		std::shared_ptr<WorkerPool> validation_pool_;
+		std::shared_ptr<worker_metrics> validation_metrics_;
+
+		compression_options compression_;
+		std::shared_ptr<compression_metrics> compression_metrics_;
+
+		// Authenticated sessions, target of broadcast. Taken before the shard
+		// locks of topics_ in do_join, never while one is held.
+		std::mutex sessions_mutex_;
+		std::list<std::weak_ptr<base_session_type>> sessions_;
+
+		// Authenticated sessions by the topics named in their key message
+		std::shared_ptr<TopicRegistry<base_session_type>> topics_;
+
+		// Last broadcasts for sessions that resume, guarded by sessions_mutex_.
+		// Sequences are only comparable within one epoch, a start begins a new one.
+		std::size_t replay_capacity_;
+		std::unique_ptr<ReplayLog> broadcast_log_;
+		std::uint64_t replay_epoch_;
 		
 	public:
 		explicit WSServerKey()
-			: on_data_(NULL)
+			: thread_per_core_(false)
+			, certificate_watch_interval_(0)
+			, on_data_(NULL)
 			, on_error_(NULL)
 			, on_join_(NULL)
 			, on_leave_(NULL)
-			, on_validate_(NULL) {
+			, on_validate_(NULL)
+			, write_batching_(false)
+			, max_batch_bytes_(default_max_batch_bytes)
+			, idle_timeout_(default_idle_timeout)
+			, ping_interval_(0)
+			, handshake_metrics_(std::make_shared<handshake_metrics>())
+			, handshake_threads_(0)
+			, max_pending_handshakes_(0)
+			, ktls_(false)
+			, validation_threads_(0)
+			, max_queued_validations_(0)
+			, validation_metrics_(std::make_shared<worker_metrics>())
+			, compression_metrics_(std::make_shared<compression_metrics>())
+			, topics_(std::make_shared<TopicRegistry<base_session_type>>())
+			, replay_capacity_(0)
+			, replay_epoch_(0) {
 		}
 		virtual ~WSServerKey() {
 			stop();
@@ -82,57 +163,186 @@ namespace websocket {
 
 		bool start(size_t thread_count) {
 			thread_count = std::max<size_t>(1, thread_count);
-			io_context_ = std::make_unique<boost::asio::io_context>(thread_count);
-			if (!io_context_) {
-				return false;
+
+			// Thread per core runs one single threaded io_context per thread
+			size_t context_count = thread_per_core_ ? thread_count : 1;
+			size_t threads_per_context = thread_per_core_ ? 1 : thread_count;
+			for (size_t i = 0; i < context_count; ++i) {
+				io_contexts_.emplace_back(std::make_unique<boost::asio::io_context>(static_cast<int>(threads_per_context)));
+			}
+			topics_->set_lanes(threads_per_context);
+
+			std::shared_ptr<boost::asio::ssl::context> ssl_context;
+			if (has_ssl_config()) {
+				certificate_times_ = certificate_file_times();
+				ssl_context = make_ssl_context();
+				if (!ssl_context) {
+					release();
+					return false;
+				}
+
+				if (handshake_threads_ > 0) {
+					handshake_pool_ = std::make_shared<HandshakePool>(handshake_threads_, max_pending_handshakes_);
+				}
 			}
 
-			listener_ = std::make_shared<Listener<server_session_type, base_session_type>>(*io_context_, endpoint_);
-			if (!listener_) {
-				return false;
+			if (admission_limits_.max_connections != 0 ||
+				admission_limits_.max_connections_per_ip != 0 ||
+				admission_limits_.max_pending_handshakes != 0 ||
+				admission_limits_.accept_rate != 0) {
+				admission_ = std::make_shared<AdmissionControl>(admission_limits_);
 			}
 
-			if (ssl_config_) {
-				boost::asio::ssl::context ctx{ ssl_config_->method };
-				ctx.use_certificate_file(ssl_config_->certificate_file_path, ssl_config_->file_format);
-				ctx.use_rsa_private_key_file(ssl_config_->private_key_file_path, ssl_config_->file_format);
-				listener_->set_ssl_context(std::move(ctx));
+			if (replay_capacity_ > 0) {
+				std::lock_guard<std::mutex> guard(sessions_mutex_);
+				broadcast_log_ = std::make_unique<ReplayLog>(replay_capacity_);
+				replay_epoch_ = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+					std::chrono::system_clock::now().time_since_epoch()).count());
+			}
+
+			if (validation_threads_ > 0) {
+				validation_pool_ = std::make_shared<WorkerPool>(
+					validation_threads_, max_queued_validations_, validation_metrics_);
 			}
 
 			channel_ = std::make_shared<Channel>();
 			if (channel_) {
 				channel_->subscribe(std::bind(&WSServerKey::on_received_data, this, std::placeholders::_1));
-				listener_->set_channel(channel_);
 			}
 
-			listener_->set_handshake_completed_handler(
-				std::bind(&WSServerKey::on_client_join,
-					this, std::placeholders::_1));
+			std::unique_lock<std::mutex> listeners_guard(listeners_mutex_);
+			if (!thread_per_core_) {
+				listeners_.emplace_back(make_listener(*io_contexts_.front(), ssl_context));
+			}
+			else if (listener_type::is_reuse_port_supported()) {
+				// Every core accepts on its own socket bound to the same endpoint
+				for (auto& ioc : io_contexts_) {
+					auto listener = make_listener(*ioc, ssl_context);
+					listener->set_reuse_port(true);
+					listener->set_use_strand(false);
+					listeners_.emplace_back(std::move(listener));
+				}
+			}
+			else {
+				// Without SO_REUSEPORT one acceptor hands connections round robin
+				auto listener = make_listener(*io_contexts_.front(), ssl_context);
+				listener->set_use_strand(false);
+				for (auto& ioc : io_contexts_) {
+					listener->add_worker_context(*ioc);
+				}
+				listeners_.emplace_back(std::move(listener));
+			}
+			listeners_guard.unlock();
 
 			// Start to listen
-			if (!listener_->run()) return false;
+			for (auto& listener : listeners_) {
+				if (!listener->run()) {
+					release();
+					return false;
+				}
+			}
 			log("Server started!\tlisten port=%s!", endpoint_.port());
+
+			if (ssl_context && certificate_watch_interval_.count() > 0) {
+				certificate_watch_timer_ = std::make_unique<boost::asio::steady_timer>(*io_contexts_.front());
+				watch_certificate();
+			}
 		
 			// Enable work threads
-			thread_group_.create_thread_count(
-				[this]() { io_context_->run(); },
-				thread_count);
+			for (auto& ioc : io_contexts_) {
+				auto context = ioc.get();
+				thread_group_.create_thread_count(
+					[context]() { context->run(); },
+					threads_per_context);
+			}
 
 			return true;
 		}
 
 		void stop() {
-			if (listener_) {
-				listener_->stop();
+			release();
+
+			std::lock_guard<std::mutex> guard(ssl_mutex_);
+			ssl_config_.reset();
+			ticket_keys_.reset();
+		}
+
+		// Send one message to every authenticated session. The payload is
+		// built once and shared by all recipients.
+		size_t broadcast(std::string&& data, frame_type type = frame_type::text) {
+			return broadcast(write_message(make_shared_message(std::move(data)), type));
+		}
+
+		size_t broadcast(SharedMessage message, frame_type type = frame_type::text) {
+			return broadcast(write_message(std::move(message), type));
+		}
+
+		// Zero copy broadcast of caller owned memory, which must stay valid
+		// until holder is released by the last session.
+		size_t broadcast(const char* data, size_t data_len, frame_type type, std::shared_ptr<void> holder) {
+			return broadcast(write_message(boost::asio::buffer(data, data_len), std::move(holder), type));
+		}
+
+		size_t broadcast(const write_message& message) {
+			std::vector<std::shared_ptr<base_session_type>> targets;
+			{
+				std::lock_guard<std::mutex> guard(sessions_mutex_);
+				if (broadcast_log_) {
+					broadcast_log_->append(message);
+				}
+				targets.reserve(sessions_.size());
+				auto itor = sessions_.begin();
+				while (itor != sessions_.end()) {
+					if (auto session = itor->lock()) {
+						targets.emplace_back(std::move(session));
+						++itor;
+					}
+					else {
+						itor = sessions_.erase(itor);
+					}
+				}
 			}
-			if (io_context_) {
-				io_context_->stop();
+			return send_to(targets, message);
+		}
+
+		// Send one message to the sessions subscribed to topic. Returns the
+		// sessions it was queued for.
+		size_t publish(const std::string& topic, std::string&& data, frame_type type = frame_type::text) {
+			return publish(topic, write_message(make_shared_message(std::move(data)), type));
+		}
+
+		size_t publish(const std::string& topic, SharedMessage message, frame_type type = frame_type::text) {
+			return publish(topic, write_message(std::move(message), type));
+		}
+
+		size_t publish(const std::string& topic, const write_message& message) {
+			return topics_->publish(topic, message);
+		}
+
+		// Sequence of the last publish to topic, zero without replay
+		std::uint64_t last_sequence(const std::string& topic) {
+			return topics_->last_sequence(topic);
+		}
+
+		bool subscribe(const std::string& topic, const std::shared_ptr<base_session_type>& session) {
+			return topics_->subscribe(topic, session);
+		}
+
+		bool unsubscribe(const std::string& topic, const std::shared_ptr<base_session_type>& session) {
+			return topics_->unsubscribe(topic, session);
+		}
+
+		// Send one message to the given sessions, it should be shared or a
+		// view since every session receives its own copy of the message.
+		template<typename Sessions>
+		size_t send_to(const Sessions& sessions, const write_message& message) {
+			size_t count = 0;
+			for (const auto& session : sessions) {
+				if (session && session->send(write_message(message))) {
+					++count;
+				}
 			}
-			thread_group_.join_and_clear_all();
-			
-			listener_.reset();
-			ssl_config_.reset();
-			channel_.reset();
+			return count;
 		}
 		
 		void set_listener(const char* address, unsigned short port) {
@@ -144,6 +354,70 @@ namespace websocket {
 			key_ = Key;
 		}
 
+		void set_write_batching(bool enable, std::size_t max_batch_bytes) {
+			write_batching_ = enable;
+			max_batch_bytes_ = max_batch_bytes;
+		}
+
+		// Bound every session write queue, see overflow_policy
+		void set_write_queue_limits(const write_queue_limits& limits) {
+			write_limits_ = limits;
+		}
+
+		// Notified when a session crosses its watermarks so producers can
+		// throttle. Runs on the session strand, not inside broadcast or
+		// publish, so the handler may call them.
+		void set_watermark_handler(const WatermarkHandler<base_session_type>& handler) {
+			watermark_handler_ = handler;
+		}
+
+		// Close sessions that received nothing for this long, zero disables it
+		void set_idle_timeout(std::chrono::milliseconds timeout) {
+			idle_timeout_ = timeout;
+		}
+
+		// Ping clients idle for this long, zero relies on client pings
+		void set_ping_interval(std::chrono::milliseconds interval) {
+			ping_interval_ = interval;
+		}
+
+		// Run one io_context and listener per thread instead of sharing one
+		// io_context between all threads. Sessions stay on the thread that
+		// accepted them and need no strand. Must be set before start.
+		void set_thread_per_core(bool enable) {
+			thread_per_core_ = enable;
+		}
+
+		// Cap connections, connections per address, pending handshakes and
+		// the accept rate. Zero leaves a limit off. Must be set before start.
+		void set_admission_limits(const admission_limits& limits) {
+			admission_limits_ = limits;
+		}
+
+		// TCP tuning of the listening and accepted sockets, set before start
+		void set_socket_options(const socket_options& options) {
+			socket_options_ = options;
+		}
+
+		const socket_options& get_socket_options() const {
+			return socket_options_;
+		}
+
+		// Session cache and tickets of the TLS context, set before start
+		void set_tls_resumption(const tls_resumption_options& options) {
+			tls_resumption_ = options;
+		}
+
+		// Full, resumed and failed TLS handshakes of every listener
+		std::shared_ptr<handshake_metrics> get_handshake_metrics() const {
+			return handshake_metrics_;
+		}
+
+		// Nullptr when no limit is set
+		std::shared_ptr<AdmissionControl> admission_control() const {
+			return admission_;
+		}
+
 		void set_ssl_config(int ssl_method, 
 			const char* certificate_file_path,
 			const char* private_key_file_path,
@@ -155,9 +429,90 @@ namespace websocket {
 				static_cast<boost::asio::ssl::context::file_format>(file_format)
 			};
 
+			std::lock_guard<std::mutex> guard(ssl_mutex_);
 			ssl_config_ = std::make_unique<ssl_config>(std::move(config));
 		}
 
+		// Load the certificate files of the ssl config again, they may have
+		// been changed by set_ssl_config. New handshakes use them at once,
+		// established sessions keep their certificate. Returns false and
+		// keeps the current certificate if the files do not load.
+		bool reload_certificate() {
+			auto context = make_ssl_context();
+			if (!context) {
+				return false;
+			}
+			std::lock_guard<std::mutex> guard(listeners_mutex_);
+			for (auto& listener : listeners_) {
+				listener->set_ssl_context(context);
+			}
+			log("Certificate reloaded");
+			return true;
+		}
+
+		// Run TLS handshakes on thread_count threads of their own instead of
+		// the request threads. Listeners stop accepting while max_pending
+		// handshakes are queued or running, zero never stops. Set before start.
+		void set_handshake_threads(std::size_t thread_count, std::size_t max_pending) {
+			handshake_threads_ = thread_count;
+			max_pending_handshakes_ = max_pending;
+		}
+
+		// Run OnValidate and OnData on thread_count threads of their own
+		// instead of the request threads. Once max_queued messages wait, the
+		// request thread validates the next one itself, zero never does.
+		// Set before start.
+		void set_validation_threads(std::size_t thread_count, std::size_t max_queued) {
+			validation_threads_ = thread_count;
+			max_queued_validations_ = max_queued;
+		}
+
+		// Queue depth and wait of the validation threads
+		std::shared_ptr<worker_metrics> get_validation_metrics() const {
+			return validation_metrics_;
+		}
+
+		// Linux kernel TLS for AES-GCM sessions, others stay in OpenSSL.
+		// Counted in the handshake metrics. Set before start.
+		void set_ktls(bool enable) {
+			ktls_ = enable;
+		}
+
+		// permessage-deflate for clients that offer it, set before start
+		void set_compression(const compression_options& options) {
+			compression_ = options;
+		}
+
+		// Keep the last capacity messages of broadcast and of every topic, so
+		// a client that joins again can resume from the last sequence it got.
+		// Zero disables it, set before start.
+		void set_replay(std::size_t capacity) {
+			replay_capacity_ = capacity;
+			topics_->set_replay(capacity);
+		}
+
+		// Topics that keep a replay log at most, see TopicRegistry. A client
+		// resuming a topic whose log was evicted is told snapshot_required.
+		void set_replay_topics(std::size_t count) {
+			topics_->set_replay_topics(count);
+		}
+
+		// Messages sent compressed by every listener
+		std::shared_ptr<compression_metrics> get_compression_metrics() const {
+			return compression_metrics_;
+		}
+
+		// Nullptr unless TLS handshakes run on their own threads
+		std::shared_ptr<HandshakePool> handshake_pool() const {
+			return handshake_pool_;
+		}
+
+		// Check the modification time of the certificate and key files every
+		// interval and reload once they changed. Zero disables it. Set before start.
+		void set_certificate_watch(std::chrono::seconds interval) {
+			certificate_watch_interval_ = interval;
+		}
+
 		void register_on_data(OnData on_data, void* object) {
 			on_data_ = on_data;
 			on_data_object_ = object;
@@ -183,44 +538,161 @@ namespace websocket {
 		}
 
 	private:
+		// Undo start, the configuration is kept so start may be called again
+		void release() {
+			if (certificate_watch_timer_) {
+				certificate_watch_timer_->cancel();
+			}
+			std::vector<std::shared_ptr<listener_type>> listeners;
+			{
+				std::lock_guard<std::mutex> guard(listeners_mutex_);
+				listeners.swap(listeners_);
+			}
+			for (auto& listener : listeners) {
+				listener->stop();
+			}
+			for (auto& ioc : io_contexts_) {
+				ioc->stop();
+			}
+			thread_group_.join_and_clear_all();
+			if (handshake_pool_) {
+				handshake_pool_->stop();
+				handshake_pool_.reset();
+			}
+			if (validation_pool_) {
+				validation_pool_->stop();
+				validation_pool_.reset();
+			}
+			
+			listeners.clear();
+			certificate_watch_timer_.reset();
+			// Groups of the registry hold strands of the contexts
+			topics_->clear();
+			io_contexts_.clear();
+			admission_.reset();
+			channel_.reset();
+
+			std::lock_guard<std::mutex> guard(sessions_mutex_);
+			sessions_.clear();
+			broadcast_log_.reset();
+		}
+
+		bool has_ssl_config() {
+			std::lock_guard<std::mutex> guard(ssl_mutex_);
+			return ssl_config_ != nullptr;
+		}
+
+		// Context of the current ssl config, nullptr if its files do not load
+		std::shared_ptr<boost::asio::ssl::context> make_ssl_context() {
+			std::lock_guard<std::mutex> guard(ssl_mutex_);
+			if (!ssl_config_) {
+				return nullptr;
+			}
+
+			boost::system::error_code ec;
+			auto context = std::make_shared<boost::asio::ssl::context>(ssl_config_->method);
+			context->use_certificate_file(ssl_config_->certificate_file_path, ssl_config_->file_format, ec);
+			if (!ec) {
+				context->use_rsa_private_key_file(ssl_config_->private_key_file_path, ssl_config_->file_format, ec);
+			}
+			if (ec) {
+				// Also when a rotation replaced only one of the files so far
+				exception_log("ssl certificate", ec);
+				return nullptr;
+			}
+
+			// Tickets issued before a reload stay valid
+			ticket_keys_ = enable_tls_resumption(*context, tls_resumption_, ticket_keys_);
+			return context;
+		}
+
+		std::pair<std::filesystem::file_time_type, std::filesystem::file_time_type> certificate_file_times() {
+			std::lock_guard<std::mutex> guard(ssl_mutex_);
+			if (!ssl_config_) {
+				return {};
+			}
+			std::error_code ec;
+			return {
+				std::filesystem::last_write_time(ssl_config_->certificate_file_path, ec),
+				std::filesystem::last_write_time(ssl_config_->private_key_file_path, ec)
+			};
+		}
+
+		void watch_certificate() {
+			certificate_watch_timer_->expires_after(certificate_watch_interval_);
+			certificate_watch_timer_->async_wait([this](boost::system::error_code ec) {
+				if (ec) {
+					return;
+				}
+				// Retried next time while the files are incomplete
+				auto times = certificate_file_times();
+				if (times != certificate_times_ && reload_certificate()) {
+					certificate_times_ = times;
+				}
+				watch_certificate();
+			});
+		}
+
+		std::shared_ptr<listener_type> make_listener(boost::asio::io_context& ioc,
+			std::shared_ptr<boost::asio::ssl::context> ssl_context) {
+			auto listener = std::make_shared<listener_type>(ioc, endpoint_);
+			listener->set_ktls(ktls_);
+			if (ssl_context) {
+				listener->set_ssl_context(ssl_context);
+			}
+			listener->set_channel(channel_);
+			listener->set_write_batching(write_batching_, max_batch_bytes_);
+			listener->set_write_queue_limits(write_limits_);
+			listener->set_idle_timeout(idle_timeout_);
+			listener->set_ping_interval(ping_interval_);
+			listener->set_socket_options(socket_options_);
+			listener->set_handshake_metrics(handshake_metrics_);
+			listener->set_handshake_pool(handshake_pool_);
+			listener->set_compression(compression_);
+			listener->set_compression_metrics(compression_metrics_);
+			if (admission_) {
+				listener->set_admission_control(admission_);
+			}
+			listener->set_watermark_handler(
+				[this](bool is_above, std::shared_ptr<base_session_type> session) {
+				if (is_above) {
+					log("Session write queue above high watermark, queued bytes=%d", session->queued_bytes());
+				}
+				if (watermark_handler_) {
+					watermark_handler_(is_above, session);
+				}
+			});
+
+			listener->set_handshake_completed_handler(
+				std::bind(&WSServerKey::on_client_join,
+					this, std::placeholders::_1));
+			return listener;
+		}
+
 		void on_client_join(std::shared_ptr<base_session_type> session) {
 			session->receive(std::move(
 				boost::beast::bind_front_handler(
 					&WSServerKey::on_read_Key, this)));
 		}
 
-		void do_write_response(unsigned short status_code, std::shared_ptr<base_session_type> session, const std::string& error) {
-			boost::property_tree::ptree tree;
-			bool is_error_occurred = false;
+		// replay is the serialized replay object of a 200 response, if any
+		void do_write_response(unsigned short status_code, std::shared_ptr<base_session_type> session, const std::string& error,
+			std::string_view replay = std::string_view()) {
+			bool is_error_occurred = true;
 			switch (status_code) {
 			case 200:
-				tree.add("status_code", "200");
-				tree.add("message", "OK");
+				is_error_occurred = false;
 				log_debug("Send response = 200 OK");
 				break;
 			case 401:
-				tree.add("status_code", "401");
-				tree.add("message", "Unauthorized");
-				if (!error.empty()) {
-					tree.add("error", error);
-				}
-				is_error_occurred = true;
 				log_debug("Send response = 401 Unauthorized");
 				break;
 			default:
-				tree.add("status_code", "400");
-				tree.add("message", "Bad Request");
-				if (!error.empty()) {
-					tree.add("error", error);
-				}
-				is_error_occurred = true;
+				status_code = 400;
 				log_debug("Send response = 400 Request");
 			}
 
-			std::stringstream ss;
-			boost::property_tree::json_parser::write_json(ss, tree);
-
-			session->send(std::move(ss.str()), 
+			AsyncWriteHandler<base_session_type> on_sent =
 				[this, is_error_occurred](boost::beast::error_code ec,
 					std::size_t bytes_transferred,
 					std::shared_ptr<base_session_type> session) {
@@ -230,12 +702,173 @@ namespace websocket {
 				}
 				log_debug("Send response Done");
 				if (!is_error_occurred) {
-					session->receive(
+					session->receive_view(
 						std::bind(&WSServerKey::on_read, this,
 							std::placeholders::_1, std::placeholders::_2,
 							std::placeholders::_3, std::placeholders::_4));
 				}
+			};
+
+			if (error.empty() && replay.empty()) {
+				session->send(fixed_response(status_code), std::move(on_sent));
+			}
+			else {
+				session->send(write_response(status_code, error, replay), std::move(on_sent));
+			}
+		}
+
+		// Responses without error or replay are the same bytes for every
+		// session, they are written once and shared by all of them
+		static SharedMessage fixed_response(unsigned short status_code) {
+			static const SharedMessage ok = make_shared_message(write_response(200, "", std::string_view()));
+			static const SharedMessage unauthorized = make_shared_message(write_response(401, "", std::string_view()));
+			static const SharedMessage bad_request = make_shared_message(write_response(400, "", std::string_view()));
+			switch (status_code) {
+			case 200:
+				return ok;
+			case 401:
+				return unauthorized;
+			default:
+				return bad_request;
+			}
+		}
+
+		static std::string write_response(unsigned short status_code, std::string_view error, std::string_view replay) {
+			std::string response;
+			response.reserve(64 + error.size() + replay.size());
+			json::writer writer(response);
+			writer.begin_object();
+			switch (status_code) {
+			case 200:
+				writer.key("status_code").string("200");
+				writer.key("message").string("OK");
+				if (!replay.empty()) {
+					writer.key("replay").raw(replay);
+				}
+				break;
+			case 401:
+				writer.key("status_code").string("401");
+				writer.key("message").string("Unauthorized");
+				break;
+			default:
+				writer.key("status_code").string("400");
+				writer.key("message").string("Bad Request");
+			}
+			if (status_code != 200 && !error.empty()) {
+				writer.key("error").string(error);
+			}
+			writer.end_object();
+			return response;
+		}
+
+		// The key message may name topics and the last sequences the client got
+		// before it reconnected, e.g.
+		//	{"key": "...", "topics": ["shop/12", "terminal/3"],
+		//	 "resume": {"epoch": 1700000000000, "broadcast": 41, "topics": {"shop/12": 17}}}
+		// The 200 response and the missed messages are queued with the channels
+		// locked, so nothing published meanwhile comes before them.
+		void do_join(std::shared_ptr<base_session_type> session, const json::value& key) {
+			std::vector<replay_point> points;
+			key["topics"].for_each([&](const json::value& topic) {
+				replay_point point;
+				if (topic.get(point.channel)) {
+					points.push_back(std::move(point));
+				}
 			});
+			std::sort(points.begin(), points.end(),
+				[](const replay_point& a, const replay_point& b) { return a.channel < b.channel; });
+			points.erase(std::unique(points.begin(), points.end(),
+				[](const replay_point& a, const replay_point& b) { return a.channel == b.channel; }), points.end());
+
+			replay_point broadcast;
+			bool is_stale = false;
+			json::value resume = key["resume"];
+			if (resume.is_object()) {
+				std::uint64_t epoch = 0;
+				resume["epoch"].get(epoch);
+				is_stale = epoch != replay_epoch_;
+				broadcast.resume = resume["broadcast"].get(broadcast.sequence);
+
+				json::value sequences = resume["topics"];
+				for (auto& point : points) {
+					point.resume = sequences[point.channel].get(point.sequence);
+				}
+			}
+
+			// Lock order is sessions_mutex_, then the shards of the topics in
+			// join. Broadcast holds sessions_mutex_ alone and publish a shard
+			// alone, so neither can wait on the other in a cycle.
+			std::lock_guard<std::mutex> guard(sessions_mutex_);
+			topics_->join(session, points, [&](std::vector<replay_point>& points) {
+				if (broadcast_log_) {
+					broadcast_log_->replay(broadcast);
+				}
+				// Sequences of another run say nothing about this one
+				if (is_stale) {
+					mark_stale(broadcast);
+					for (auto& point : points) {
+						mark_stale(point);
+					}
+				}
+
+				if (replay_capacity_ == 0) {
+					do_write_response(200, session, "");
+					return;
+				}
+				do_write_response(200, session, "", write_replay(broadcast, points));
+
+				for (auto& message : broadcast.missed) {
+					session->send(std::move(message));
+				}
+				for (auto& point : points) {
+					for (auto& message : point.missed) {
+						session->send(std::move(message));
+					}
+				}
+			});
+			sessions_.emplace_back(session);
+		}
+
+		static void mark_stale(replay_point& point) {
+			if (point.resume) {
+				point.status = replay_status::snapshot_required;
+				point.missed.clear();
+			}
+		}
+
+		// {"epoch": 1700000000000, "broadcast": {"sequence": 45, "status": "resumed"},
+		//  "topics": {"shop/12": {"sequence": 20, "status": "snapshot_required"}}}
+		std::string write_replay(const replay_point& broadcast, const std::vector<replay_point>& points) const {
+			auto write_point = [](json::writer& writer, const replay_point& point) {
+				writer.begin_object();
+				writer.key("sequence").number(point.sequence);
+				switch (point.status) {
+				case replay_status::resumed:
+					writer.key("status").string("resumed");
+					break;
+				case replay_status::snapshot_required:
+					writer.key("status").string("snapshot_required");
+					break;
+				default:
+					writer.key("status").string("started");
+				}
+				writer.end_object();
+			};
+
+			std::string replay;
+			json::writer writer(replay);
+			writer.begin_object();
+			writer.key("epoch").number(replay_epoch_);
+			writer.key("broadcast");
+			write_point(writer, broadcast);
+			writer.key("topics").begin_object();
+			for (const auto& point : points) {
+				writer.key(point.channel);
+				write_point(writer, point);
+			}
+			writer.end_object();
+			writer.end_object();
+			return replay;
 		}
 
 		void on_read_Key(
@@ -247,23 +880,24 @@ namespace websocket {
 			unsigned short status_code = 400;
 			std::string error;
 			try {
-				std::stringstream ss(data);
-				boost::property_tree::ptree pTree;
-				boost::property_tree::json_parser::read_json(ss, pTree);				
-
-				std::string key = pTree.get<std::string>("key");
-				if (key != key_) {
+				json::value message = json::parse(data);
+				json::value key = message["key"];
+				if (!message.is_object()) {
+					log("Invalid Key format");
+				}
+				else if (!key.is_string()) {
+					log("Key not found");
+				}
+				else if (!key.equals(key_)) {
 					log("Invalid Key");
 					error = "Invalid Key";
 					status_code = 401;
 				}
 				else {
-					status_code = 200;
+					do_join(session, message);
+					return;
 				}
 			}
-			catch (boost::property_tree::json_parser::json_parser_error& ec) {
-				exception_log("Invalid Key format", ec);
-			}
 			catch (std::exception& ec) {
 				log("Unknown exception in parse Key JOSN, ec=%s", ec.what());
 			}
@@ -273,28 +907,42 @@ namespace websocket {
 		void on_read(
 			boost::beast::error_code ec,
 			std::size_t bytes_transferred, 
-			std::string&& read_data,
+			std::string_view read_data,
 			std::shared_ptr<base_session_type> session) {
-			if (on_validate_) {
-				unsigned int error_buffer_len = 1024;
-				char* error_buffer = new char[error_buffer_len];
-				size_t ret = on_validate_(read_data.c_str(), read_data.size(), error_buffer, error_buffer_len, on_validate_object_);
-				if (0 == ret) {
-					do_write_response(200, session,"");
-					on_received_data(read_data);
-				}
-				else {
-					do_write_response(400, session, std::string(error_buffer, ret));
-				}
+			if (!on_validate_) {
+				return;
+			}
 
-				delete error_buffer;
+			// The view is only valid during the call, a worker gets a copy
+			if (validation_pool_ && validation_pool_->run(
+				[this, data = std::string(read_data), session]() { validate(data, session); })) {
+				return;
 			}
+			validate(read_data, session);
+		}
 
+		// A session reads its next message once the response is written, so
+		// its messages are validated one at a time and in order on any thread.
+		// OnData runs before the response for the same reason. send is safe
+		// from a worker, the response is written on the session strand.
+		void validate(std::string_view data, const std::shared_ptr<base_session_type>& session) {
+			const unsigned int error_buffer_len = 1024;
+			char error_buffer[error_buffer_len];
+			size_t ret = on_validate_(data.data(), static_cast<unsigned int>(data.size()),
+				error_buffer, error_buffer_len, on_validate_object_);
+			if (0 == ret) {
+				on_received_data(data);
+				do_write_response(200, session, "");
+			}
+			else {
+				do_write_response(400, session, std::string(error_buffer, std::min<size_t>(ret, error_buffer_len)));
+			}
 		}
 
-		void on_received_data(const std::string& data) {
+		// The data is only valid during the call
+		void on_received_data(std::string_view data) {
 			if (on_data_) {
-				on_data_(data.c_str(), data.size(), on_data_object_);
+				on_data_(data.data(), static_cast<unsigned int>(data.size()), on_data_object_);
 			}
 		}
 	};
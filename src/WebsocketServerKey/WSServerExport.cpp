@@ -62,12 +62,144 @@ extern "C" {
 		reinterpret_cast<KeyServerInterface*>(ptr)->SetCertificate(certificate_file, private_key_file);
 	}
 
+	WSSERVER_API int __cdecl ReloadCertificate(void* ptr)
+	{
+		if (!ptr) return false;
+		return reinterpret_cast<KeyServerInterface*>(ptr)->ReloadCertificate();
+	}
+
+	WSSERVER_API void __cdecl SetCertificateWatch(void* ptr, unsigned int intervalSeconds)
+	{
+		if (!ptr) return;
+		reinterpret_cast<KeyServerInterface*>(ptr)->SetCertificateWatch(intervalSeconds);
+	}
+
 	WSSERVER_API void __cdecl SetKey(void* ptr, const char* key)
 	{
 		if (!ptr) return;
 		reinterpret_cast<KeyServerInterface*>(ptr)->SetKey(key);
 	}
 
+	WSSERVER_API void __cdecl SetIdleTimeout(void* ptr, unsigned int idleSeconds)
+	{
+		if (!ptr) return;
+		reinterpret_cast<KeyServerInterface*>(ptr)->SetIdleTimeout(idleSeconds);
+	}
+
+	WSSERVER_API void __cdecl SetPingInterval(void* ptr, unsigned int pingSeconds)
+	{
+		if (!ptr) return;
+		reinterpret_cast<KeyServerInterface*>(ptr)->SetPingInterval(pingSeconds);
+	}
+
+	WSSERVER_API void __cdecl SetThreadPerCore(void* ptr, int enable)
+	{
+		if (!ptr) return;
+		reinterpret_cast<KeyServerInterface*>(ptr)->SetThreadPerCore(enable != 0);
+	}
+
+	WSSERVER_API void __cdecl SetAdmissionLimits(void* ptr, unsigned int maxConnections, unsigned int maxPerIp,
+		unsigned int maxPendingHandshakes, unsigned int acceptRate)
+	{
+		if (!ptr) return;
+		reinterpret_cast<KeyServerInterface*>(ptr)->SetAdmissionLimits(
+			maxConnections, maxPerIp, maxPendingHandshakes, acceptRate);
+	}
+
+	WSSERVER_API void __cdecl GetSocketOptions(void* ptr, WSSocketOptions* options)
+	{
+		if (!ptr || !options) return;
+		reinterpret_cast<KeyServerInterface*>(ptr)->GetSocketOptions(*options);
+	}
+
+	WSSERVER_API void __cdecl SetSocketOptions(void* ptr, const WSSocketOptions* options)
+	{
+		if (!ptr || !options) return;
+		reinterpret_cast<KeyServerInterface*>(ptr)->SetSocketOptions(*options);
+	}
+
+	WSSERVER_API void __cdecl SetTLSResumption(void* ptr, unsigned int cacheSize, unsigned int timeoutSeconds,
+		int enableTickets, unsigned int ticketKeyRotationSeconds)
+	{
+		if (!ptr) return;
+		reinterpret_cast<KeyServerInterface*>(ptr)->SetTLSResumption(
+			cacheSize, timeoutSeconds, enableTickets != 0, ticketKeyRotationSeconds);
+	}
+
+	WSSERVER_API void __cdecl SetHandshakeThreads(void* ptr, unsigned int threadCount, unsigned int maxPending)
+	{
+		if (!ptr) return;
+		reinterpret_cast<KeyServerInterface*>(ptr)->SetHandshakeThreads(threadCount, maxPending);
+	}
+
+	WSSERVER_API unsigned int __cdecl GetHandshakeQueueDepth(void* ptr)
+	{
+		if (!ptr) return 0;
+		return reinterpret_cast<KeyServerInterface*>(ptr)->GetHandshakeQueueDepth();
+	}
+
+	WSSERVER_API void __cdecl GetHandshakeCounts(void* ptr,
+		unsigned long long* fullHandshakes, unsigned long long* resumedHandshakes,
+		unsigned long long* failedHandshakes)
+	{
+		if (!ptr) return;
+		reinterpret_cast<KeyServerInterface*>(ptr)->GetHandshakeCounts(
+			fullHandshakes, resumedHandshakes, failedHandshakes);
+	}
+
+	WSSERVER_API void __cdecl SetKernelTLS(void* ptr, int enable)
+	{
+		if (!ptr) return;
+		reinterpret_cast<KeyServerInterface*>(ptr)->SetKernelTLS(enable != 0);
+	}
+
+	WSSERVER_API void __cdecl GetKernelTLSCounts(void* ptr,
+		unsigned long long* sendSessions, unsigned long long* receiveSessions,
+		unsigned long long* fallbackSessions)
+	{
+		if (!ptr) return;
+		reinterpret_cast<KeyServerInterface*>(ptr)->GetKernelTLSCounts(
+			sendSessions, receiveSessions, fallbackSessions);
+	}
+
+	WSSERVER_API void __cdecl SetCompression(void* ptr, int enable,
+		unsigned int windowBits, unsigned int memoryLevel,
+		int noContextTakeover, unsigned int threshold)
+	{
+		if (!ptr) return;
+		reinterpret_cast<KeyServerInterface*>(ptr)->SetCompression(
+			enable != 0, windowBits, memoryLevel, noContextTakeover != 0, threshold);
+	}
+
+	WSSERVER_API void __cdecl GetCompressionCounts(void* ptr,
+		unsigned long long* messages, unsigned long long* payloadBytes,
+		unsigned long long* wireBytes, unsigned long long* cpuMicroseconds)
+	{
+		if (!ptr) return;
+		reinterpret_cast<KeyServerInterface*>(ptr)->GetCompressionCounts(
+			messages, payloadBytes, wireBytes, cpuMicroseconds);
+	}
+
+	WSSERVER_API void __cdecl SetReplay(void* ptr, unsigned int capacity)
+	{
+		if (!ptr) return;
+		reinterpret_cast<KeyServerInterface*>(ptr)->SetReplay(capacity);
+	}
+
+	WSSERVER_API void __cdecl SetValidationThreads(void* ptr, unsigned int threadCount, unsigned int maxQueued)
+	{
+		if (!ptr) return;
+		reinterpret_cast<KeyServerInterface*>(ptr)->SetValidationThreads(threadCount, maxQueued);
+	}
+
+	WSSERVER_API void __cdecl GetValidationCounts(void* ptr, unsigned int* queued,
+		unsigned long long* jobs, unsigned long long* waitMicroseconds, unsigned long long* inlineRuns)
+	{
+		if (!ptr) return;
+		reinterpret_cast<KeyServerInterface*>(ptr)->GetValidationCounts(
+			queued, jobs, waitMicroseconds, inlineRuns);
+	}
+
 	WSSERVER_API int __cdecl Start(void* ptr, unsigned short requestThreads)
 	{
 		if (!ptr) return false;
@@ -80,6 +212,28 @@ extern "C" {
 		reinterpret_cast<KeyServerInterface*>(ptr)->Stop();
 	}
 
+	WSSERVER_API int __cdecl Broadcast(void* ptr, const char* data, unsigned int dataLen)
+	{
+		if (!ptr || !data) return 0;
+		return static_cast<int>(reinterpret_cast<KeyServerInterface*>(ptr)->Broadcast(data, dataLen));
+	}
+
+	WSSERVER_API int __cdecl BroadcastEx(void* ptr, const char* data, unsigned int dataLen,
+		int frameType, OnRelease onRelease, void* classObject /*= NULL*/)
+	{
+		if (!ptr || !data) return 0;
+		return static_cast<int>(reinterpret_cast<KeyServerInterface*>(ptr)->BroadcastEx(
+			data, dataLen, frameType, onRelease, classObject));
+	}
+
+	WSSERVER_API int __cdecl Publish(void* ptr, const char* topic,
+		const char* data, unsigned int dataLen, int frameType)
+	{
+		if (!ptr || !topic || !data) return 0;
+		return static_cast<int>(reinterpret_cast<KeyServerInterface*>(ptr)->Publish(
+			topic, data, dataLen, frameType));
+	}
+
 #ifdef __cplusplus
 }
 #endif
@@ -16,6 +16,7 @@ extern "C" {
 	WSSERVER_API void __cdecl RegisterOnJoin(void* ptr, OnJoin onJoin, void* classObject = 0);
 	typedef void(__cdecl *OnLeave)(void*);
 	WSSERVER_API void __cdecl RegisterOnLeave(void* ptr, OnLeave onLeave, void* classObject = 0);
+	// The data passed to OnData and OnValidate is only valid during the call
 	typedef void(__cdecl *OnData)(const char*, unsigned int, void*);
 	WSSERVER_API void __cdecl RegisterOnData(void* ptr, OnData onData, void* classObject = 0);
 	typedef void(__cdecl *OnError)(int, void*);
@@ -27,12 +28,134 @@ extern "C" {
 		void* ptr, const char* address, unsigned short port);
 	WSSERVER_API void __cdecl SetCertificate(
 		void* ptr, const char* certificate_file, const char* private_key_file);
+	// Load the certificate files again, after SetCertificate to change
+	// them. New clients get the new certificate, connected ones are kept.
+	// Returns 0 and keeps the current certificate if the files do not load.
+	WSSERVER_API int __cdecl ReloadCertificate(void* ptr);
+	// Reload once the certificate files changed, checked every
+	// intervalSeconds. 0 disables it. Set before Start.
+	WSSERVER_API void __cdecl SetCertificateWatch(
+		void* ptr, unsigned int intervalSeconds);
 	WSSERVER_API void __cdecl SetKey(
 		void* ptr, const char* key);
+	// Close clients that sent nothing for idleSeconds, 0 disables it. Default 15.
+	WSSERVER_API void __cdecl SetIdleTimeout(
+		void* ptr, unsigned int idleSeconds);
+	// Ping clients idle for pingSeconds, 0 leaves pinging to the clients. Default 0.
+	WSSERVER_API void __cdecl SetPingInterval(
+		void* ptr, unsigned int pingSeconds);
+	// Non zero runs one io_context per request thread, set before Start
+	WSSERVER_API void __cdecl SetThreadPerCore(
+		void* ptr, int enable);
+	// Stop accepting while maxConnections or maxPendingHandshakes is reached,
+	// close connections over maxPerIp, accept at most acceptRate per second.
+	// 0 disables a limit, set before Start.
+	WSSERVER_API void __cdecl SetAdmissionLimits(
+		void* ptr, unsigned int maxConnections, unsigned int maxPerIp,
+		unsigned int maxPendingHandshakes, unsigned int acceptRate);
+
+	// TCP tuning of the listening and accepted sockets, 0 keeps the system
+	// default. Defaults enable noDelay and quickAck and leave the rest 0.
+	// Options the platform lacks are ignored. Set before Start.
+	typedef struct WSSocketOptions {
+		int noDelay;
+		int quickAck;
+		int sendBufferSize;
+		int receiveBufferSize;
+		int keepAlive;
+		unsigned int keepAliveIdleSeconds;
+		unsigned int keepAliveIntervalSeconds;
+		unsigned int keepAliveCount;
+		unsigned int userTimeoutMs;
+		unsigned int deferAcceptSeconds;
+		int backlog;
+	} WSSocketOptions;
+	// Fill options with the current values, to change only some of them
+	WSSERVER_API void __cdecl GetSocketOptions(
+		void* ptr, WSSocketOptions* options);
+	WSSERVER_API void __cdecl SetSocketOptions(
+		void* ptr, const WSSocketOptions* options);
+
+	// TLS session resumption. cacheSize sessions are kept in memory for
+	// timeoutSeconds, 0 disables the cache. Ticket keys are replaced every
+	// ticketKeyRotationSeconds. Defaults 20480, 7200, 1 and 3600. Set before Start.
+	WSSERVER_API void __cdecl SetTLSResumption(
+		void* ptr, unsigned int cacheSize, unsigned int timeoutSeconds,
+		int enableTickets, unsigned int ticketKeyRotationSeconds);
+	// Run TLS handshakes on threadCount threads apart from the request
+	// threads, 0 runs them on the request threads. Accepting pauses while
+	// maxPending handshakes wait, 0 never pauses. Set before Start.
+	WSSERVER_API void __cdecl SetHandshakeThreads(
+		void* ptr, unsigned int threadCount, unsigned int maxPending);
+	// TLS handshakes waiting for or running on the handshake threads
+	WSSERVER_API unsigned int __cdecl GetHandshakeQueueDepth(void* ptr);
+	// Counts of TLS handshakes of the server, any pointer may be null
+	WSSERVER_API void __cdecl GetHandshakeCounts(void* ptr,
+		unsigned long long* fullHandshakes, unsigned long long* resumedHandshakes,
+		unsigned long long* failedHandshakes);
+	// Let the Linux kernel encrypt TLS records after the handshake, for
+	// AES-GCM with TLS 1.2 or 1.3. Sessions the kernel cannot take, and
+	// every session on other systems, silently stay in OpenSSL. Set before Start.
+	WSSERVER_API void __cdecl SetKernelTLS(void* ptr, int enable);
+	// Sessions sending, and also receiving, through kernel TLS, and
+	// sessions kept in OpenSSL although requested. Any pointer may be null.
+	WSSERVER_API void __cdecl GetKernelTLSCounts(void* ptr,
+		unsigned long long* sendSessions, unsigned long long* receiveSessions,
+		unsigned long long* fallbackSessions);
+	// permessage-deflate for clients that offer it. windowBits 9..15 and
+	// memoryLevel 1..9 bound the zlib memory of every session, noContextTakeover
+	// resets the window after each message. Messages smaller than threshold
+	// bytes are sent uncompressed. Beast before msg_size_threshold, which
+	// includes Boost 1.70 and 1.74, compresses every message: there a nonzero
+	// threshold is logged at Start and ignored, pass 0. Set before Start.
+	WSSERVER_API void __cdecl SetCompression(void* ptr, int enable,
+		unsigned int windowBits, unsigned int memoryLevel,
+		int noContextTakeover, unsigned int threshold);
+	// Messages sent compressed, their size before and after compression
+	// and the CPU time spent. Any pointer may be null.
+	WSSERVER_API void __cdecl GetCompressionCounts(void* ptr,
+		unsigned long long* messages, unsigned long long* payloadBytes,
+		unsigned long long* wireBytes, unsigned long long* cpuMicroseconds);
+	// Keep the last capacity messages of Broadcast and of every topic. A
+	// client that reconnects sends in its key message the epoch and the
+	// sequences of the 200 response it got before, plus one per message
+	// received since, and is sent what it missed, or told "snapshot_required"
+	// for a channel whose messages are gone. At most 16384 topics keep a log,
+	// past it the log of a topic without sessions, published to least
+	// recently, is dropped first. Zero disables it, set before Start.
+	WSSERVER_API void __cdecl SetReplay(void* ptr, unsigned int capacity);
+	// Run OnValidate and OnData on threadCount threads of their own instead
+	// of the request threads. Once maxQueued messages wait, a request thread
+	// validates the next one itself, zero never does. Set before Start.
+	WSSERVER_API void __cdecl SetValidationThreads(void* ptr, unsigned int threadCount, unsigned int maxQueued);
+	// Messages waiting for a validation thread, messages validated by one and
+	// their total wait, and messages validated on a request thread because
+	// the queue was full. Any pointer may be null.
+	WSSERVER_API void __cdecl GetValidationCounts(void* ptr, unsigned int* queued,
+		unsigned long long* jobs, unsigned long long* waitMicroseconds, unsigned long long* inlineRuns);
 
 	WSSERVER_API int __cdecl Start(void* ptr, unsigned short requestThreads);
 	WSSERVER_API void __cdecl Stop(void* ptr);
 
+	// Send data to every authenticated client, return count of recipients
+	WSSERVER_API int __cdecl Broadcast(void* ptr, const char* data, unsigned int dataLen);
+
+	// Frame type of outgoing data
+#define WS_FRAME_TEXT		0
+#define WS_FRAME_BINARY		1
+
+	// Called once the server no longer references data given to BroadcastEx
+	typedef void(__cdecl *OnRelease)(const char*, void*);
+	// Broadcast with the given frame type. When onRelease is set the data is
+	// not copied and must stay valid until onRelease is called.
+	WSSERVER_API int __cdecl BroadcastEx(void* ptr, const char* data, unsigned int dataLen,
+		int frameType, OnRelease onRelease, void* classObject = 0);
+
+	// Send to the sessions subscribed to topic. A client subscribes with a
+	// "topics" array in its key message, e.g. {"key":"...","topics":["a","b"]}.
+	WSSERVER_API int __cdecl Publish(void* ptr, const char* topic,
+		const char* data, unsigned int dataLen, int frameType);
+
 	typedef void*(__cdecl *fnCreateServerInstance)(int);
 	typedef void(__cdecl *fnDestroyServerInstance)(void*);
 	typedef void(__cdecl *fnRegisterOnJoin)(void*, OnJoin, void*);
@@ -43,9 +166,31 @@ extern "C" {
 
 	typedef void(__cdecl *fnSetListener)(void*, const char*, unsigned short);
 	typedef void(__cdecl *fnSetCertificate)(void*, const char*, const char*);
+	typedef int(__cdecl *fnReloadCertificate)(void*);
+	typedef void(__cdecl *fnSetCertificateWatch)(void*, unsigned int);
 	typedef void(__cdecl *fnSetKey)(void*, const char*);
+	typedef void(__cdecl *fnSetIdleTimeout)(void*, unsigned int);
+	typedef void(__cdecl *fnSetPingInterval)(void*, unsigned int);
+	typedef void(__cdecl *fnSetThreadPerCore)(void*, int);
+	typedef void(__cdecl *fnSetAdmissionLimits)(void*, unsigned int, unsigned int, unsigned int, unsigned int);
+	typedef void(__cdecl *fnGetSocketOptions)(void*, WSSocketOptions*);
+	typedef void(__cdecl *fnSetSocketOptions)(void*, const WSSocketOptions*);
+	typedef void(__cdecl *fnSetTLSResumption)(void*, unsigned int, unsigned int, int, unsigned int);
+	typedef void(__cdecl *fnSetHandshakeThreads)(void*, unsigned int, unsigned int);
+	typedef unsigned int(__cdecl *fnGetHandshakeQueueDepth)(void*);
+	typedef void(__cdecl *fnGetHandshakeCounts)(void*, unsigned long long*, unsigned long long*, unsigned long long*);
+	typedef void(__cdecl *fnSetKernelTLS)(void*, int);
+	typedef void(__cdecl *fnGetKernelTLSCounts)(void*, unsigned long long*, unsigned long long*, unsigned long long*);
+	typedef void(__cdecl *fnSetCompression)(void*, int, unsigned int, unsigned int, int, unsigned int);
+	typedef void(__cdecl *fnGetCompressionCounts)(void*, unsigned long long*, unsigned long long*, unsigned long long*, unsigned long long*);
+	typedef void(__cdecl *fnSetReplay)(void*, unsigned int);
+	typedef void(__cdecl *fnSetValidationThreads)(void*, unsigned int, unsigned int);
+	typedef void(__cdecl *fnGetValidationCounts)(void*, unsigned int*, unsigned long long*, unsigned long long*, unsigned long long*);
 	typedef int(__cdecl *fnStart)(void*, unsigned short);
 	typedef void(__cdecl *fnStop)(void*);
+	typedef int(__cdecl *fnBroadcast)(void*, const char*, unsigned int);
+	typedef int(__cdecl *fnBroadcastEx)(void*, const char*, unsigned int, int, OnRelease, void*);
+	typedef int(__cdecl *fnPublish)(void*, const char*, const char*, unsigned int, int);
 
 #ifdef __cplusplus
 }
@@ -63,7 +208,29 @@ typedef std::function<void __cdecl(void*, OnError, void*)> RegisterOnErrorFunc;
 typedef std::function<void __cdecl(void*, OnValidate, void*)> RegisterOnValidateFunc;
 typedef std::function<void __cdecl(void*, const char*, unsigned short)> SetListenerFunc;
 typedef std::function<void __cdecl(void*, const char*, const char*)> SetCertificateFunc;
+typedef std::function<int __cdecl(void*)> ReloadCertificateFunc;
+typedef std::function<void __cdecl(void*, unsigned int)> SetCertificateWatchFunc;
 typedef std::function<void __cdecl(void*, const char*)> SetKeyFunc;
+typedef std::function<void __cdecl(void*, unsigned int)> SetIdleTimeoutFunc;
+typedef std::function<void __cdecl(void*, unsigned int)> SetPingIntervalFunc;
+typedef std::function<void __cdecl(void*, int)> SetThreadPerCoreFunc;
+typedef std::function<void __cdecl(void*, unsigned int, unsigned int, unsigned int, unsigned int)> SetAdmissionLimitsFunc;
+typedef std::function<void __cdecl(void*, WSSocketOptions*)> GetSocketOptionsFunc;
+typedef std::function<void __cdecl(void*, const WSSocketOptions*)> SetSocketOptionsFunc;
+typedef std::function<void __cdecl(void*, unsigned int, unsigned int, int, unsigned int)> SetTLSResumptionFunc;
+typedef std::function<void __cdecl(void*, unsigned int, unsigned int)> SetHandshakeThreadsFunc;
+typedef std::function<unsigned int __cdecl(void*)> GetHandshakeQueueDepthFunc;
+typedef std::function<void __cdecl(void*, unsigned long long*, unsigned long long*, unsigned long long*)> GetHandshakeCountsFunc;
+typedef std::function<void __cdecl(void*, int)> SetKernelTLSFunc;
+typedef std::function<void __cdecl(void*, unsigned long long*, unsigned long long*, unsigned long long*)> GetKernelTLSCountsFunc;
+typedef std::function<void __cdecl(void*, int, unsigned int, unsigned int, int, unsigned int)> SetCompressionFunc;
+typedef std::function<void __cdecl(void*, unsigned long long*, unsigned long long*, unsigned long long*, unsigned long long*)> GetCompressionCountsFunc;
+typedef std::function<void __cdecl(void*, unsigned int)> SetReplayFunc;
+typedef std::function<void __cdecl(void*, unsigned int, unsigned int)> SetValidationThreadsFunc;
+typedef std::function<void __cdecl(void*, unsigned int*, unsigned long long*, unsigned long long*, unsigned long long*)> GetValidationCountsFunc;
 typedef std::function<int __cdecl(void*, unsigned short)> StartFunc;
 typedef std::function<void __cdecl(void*)> StopFunc;
+typedef std::function<int __cdecl(void*, const char*, unsigned int)> BroadcastFunc;
+typedef std::function<int __cdecl(void*, const char*, unsigned int, int, OnRelease, void*)> BroadcastExFunc;
+typedef std::function<int __cdecl(void*, const char*, const char*, unsigned int, int)> PublishFunc;
 #endif
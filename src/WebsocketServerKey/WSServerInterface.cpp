@@ -61,6 +61,58 @@ namespace websocket {
 		}
 	}
 
+	size_t KeyServerInterface::Broadcast(const char* data, unsigned int dataLen)
+	{
+		if (!server_) return 0;
+
+		if (is_ssl_) {
+			return reinterpret_cast<KeySSLServer*>(server_)->broadcast(std::string(data, dataLen));
+		}
+		else {
+			return reinterpret_cast<KeyServer*>(server_)->broadcast(std::string(data, dataLen));
+		}
+	}
+
+	size_t KeyServerInterface::BroadcastEx(const char* data, unsigned int dataLen,
+		int frameType, OnRelease onRelease, void* classObject /*= nullptr*/)
+	{
+		if (!server_) return 0;
+
+		frame_type type = frameType == WS_FRAME_BINARY ? frame_type::binary : frame_type::text;
+		if (!onRelease) {
+			if (is_ssl_) {
+				return reinterpret_cast<KeySSLServer*>(server_)->broadcast(std::string(data, dataLen), type);
+			}
+			else {
+				return reinterpret_cast<KeyServer*>(server_)->broadcast(std::string(data, dataLen), type);
+			}
+		}
+
+		// Referenced by every session queue, released after the last write
+		auto holder = make_release_hook([data, onRelease, classObject]() {
+			onRelease(data, classObject);
+		});
+		if (is_ssl_) {
+			return reinterpret_cast<KeySSLServer*>(server_)->broadcast(data, dataLen, type, std::move(holder));
+		}
+		else {
+			return reinterpret_cast<KeyServer*>(server_)->broadcast(data, dataLen, type, std::move(holder));
+		}
+	}
+
+	size_t KeyServerInterface::Publish(const char* topic, const char* data, unsigned int dataLen, int frameType)
+	{
+		if (!server_) return 0;
+
+		frame_type type = frameType == WS_FRAME_BINARY ? frame_type::binary : frame_type::text;
+		if (is_ssl_) {
+			return reinterpret_cast<KeySSLServer*>(server_)->publish(topic, std::string(data, dataLen), type);
+		}
+		else {
+			return reinterpret_cast<KeyServer*>(server_)->publish(topic, std::string(data, dataLen), type);
+		}
+	}
+
 	void KeyServerInterface::RegisterOnJoin(OnJoin onJoin, void* classObject /*= nullptr*/)
 	{
 		if (!server_) return;
@@ -121,6 +173,30 @@ namespace websocket {
 		}
 	}
 
+	bool KeyServerInterface::ReloadCertificate()
+	{
+		if (!server_) return false;
+
+		if (is_ssl_) {
+			return reinterpret_cast<KeySSLServer*>(server_)->reload_certificate();
+		}
+		else {
+			return reinterpret_cast<KeyServer*>(server_)->reload_certificate();
+		}
+	}
+
+	void KeyServerInterface::SetCertificateWatch(unsigned int intervalSeconds)
+	{
+		if (!server_) return;
+
+		if (is_ssl_) {
+			reinterpret_cast<KeySSLServer*>(server_)->set_certificate_watch(std::chrono::seconds(intervalSeconds));
+		}
+		else {
+			reinterpret_cast<KeyServer*>(server_)->set_certificate_watch(std::chrono::seconds(intervalSeconds));
+		}
+	}
+
 	void KeyServerInterface::SetKey(const char* key)
 	{
 		if (!server_) return;
@@ -133,6 +209,255 @@ namespace websocket {
 		}
 	}
 
+	void KeyServerInterface::SetIdleTimeout(unsigned int idleSeconds)
+	{
+		if (!server_) return;
+
+		if (is_ssl_) {
+			reinterpret_cast<KeySSLServer*>(server_)->set_idle_timeout(std::chrono::seconds(idleSeconds));
+		}
+		else {
+			reinterpret_cast<KeyServer*>(server_)->set_idle_timeout(std::chrono::seconds(idleSeconds));
+		}
+	}
+
+	void KeyServerInterface::SetPingInterval(unsigned int pingSeconds)
+	{
+		if (!server_) return;
+
+		if (is_ssl_) {
+			reinterpret_cast<KeySSLServer*>(server_)->set_ping_interval(std::chrono::seconds(pingSeconds));
+		}
+		else {
+			reinterpret_cast<KeyServer*>(server_)->set_ping_interval(std::chrono::seconds(pingSeconds));
+		}
+	}
+
+	void KeyServerInterface::SetThreadPerCore(bool enable)
+	{
+		if (!server_) return;
+
+		if (is_ssl_) {
+			reinterpret_cast<KeySSLServer*>(server_)->set_thread_per_core(enable);
+		}
+		else {
+			reinterpret_cast<KeyServer*>(server_)->set_thread_per_core(enable);
+		}
+	}
+
+	void KeyServerInterface::SetAdmissionLimits(unsigned int maxConnections, unsigned int maxPerIp,
+		unsigned int maxPendingHandshakes, unsigned int acceptRate)
+	{
+		if (!server_) return;
+
+		admission_limits limits;
+		limits.max_connections = maxConnections;
+		limits.max_connections_per_ip = maxPerIp;
+		limits.max_pending_handshakes = maxPendingHandshakes;
+		limits.accept_rate = acceptRate;
+		if (is_ssl_) {
+			reinterpret_cast<KeySSLServer*>(server_)->set_admission_limits(limits);
+		}
+		else {
+			reinterpret_cast<KeyServer*>(server_)->set_admission_limits(limits);
+		}
+	}
+
+	void KeyServerInterface::GetSocketOptions(WSSocketOptions& options)
+	{
+		if (!server_) return;
+
+		const socket_options& current = is_ssl_ ?
+			reinterpret_cast<KeySSLServer*>(server_)->get_socket_options() :
+			reinterpret_cast<KeyServer*>(server_)->get_socket_options();
+		options.noDelay = current.no_delay;
+		options.quickAck = current.quick_ack;
+		options.sendBufferSize = current.send_buffer_size;
+		options.receiveBufferSize = current.receive_buffer_size;
+		options.keepAlive = current.keep_alive;
+		options.keepAliveIdleSeconds = static_cast<unsigned int>(current.keep_alive_idle.count());
+		options.keepAliveIntervalSeconds = static_cast<unsigned int>(current.keep_alive_interval.count());
+		options.keepAliveCount = static_cast<unsigned int>(current.keep_alive_count);
+		options.userTimeoutMs = static_cast<unsigned int>(current.user_timeout.count());
+		options.deferAcceptSeconds = static_cast<unsigned int>(current.defer_accept.count());
+		options.backlog = current.backlog;
+	}
+
+	void KeyServerInterface::SetSocketOptions(const WSSocketOptions& options)
+	{
+		if (!server_) return;
+
+		socket_options tuning;
+		tuning.no_delay = options.noDelay != 0;
+		tuning.quick_ack = options.quickAck != 0;
+		tuning.send_buffer_size = options.sendBufferSize;
+		tuning.receive_buffer_size = options.receiveBufferSize;
+		tuning.keep_alive = options.keepAlive != 0;
+		tuning.keep_alive_idle = std::chrono::seconds(options.keepAliveIdleSeconds);
+		tuning.keep_alive_interval = std::chrono::seconds(options.keepAliveIntervalSeconds);
+		tuning.keep_alive_count = static_cast<int>(options.keepAliveCount);
+		tuning.user_timeout = std::chrono::milliseconds(options.userTimeoutMs);
+		tuning.defer_accept = std::chrono::seconds(options.deferAcceptSeconds);
+		tuning.backlog = options.backlog;
+		if (is_ssl_) {
+			reinterpret_cast<KeySSLServer*>(server_)->set_socket_options(tuning);
+		}
+		else {
+			reinterpret_cast<KeyServer*>(server_)->set_socket_options(tuning);
+		}
+	}
+
+	void KeyServerInterface::SetTLSResumption(unsigned int cacheSize, unsigned int timeoutSeconds,
+		bool enableTickets, unsigned int ticketKeyRotationSeconds)
+	{
+		if (!server_) return;
+
+		tls_resumption_options options;
+		options.cache_size = cacheSize;
+		options.timeout = std::chrono::seconds(timeoutSeconds);
+		options.tickets = enableTickets;
+		options.ticket_key_rotation = std::chrono::seconds(ticketKeyRotationSeconds);
+		if (is_ssl_) {
+			reinterpret_cast<KeySSLServer*>(server_)->set_tls_resumption(options);
+		}
+		else {
+			reinterpret_cast<KeyServer*>(server_)->set_tls_resumption(options);
+		}
+	}
+
+	void KeyServerInterface::SetHandshakeThreads(unsigned int threadCount, unsigned int maxPending)
+	{
+		if (!server_) return;
+
+		if (is_ssl_) {
+			reinterpret_cast<KeySSLServer*>(server_)->set_handshake_threads(threadCount, maxPending);
+		}
+		else {
+			reinterpret_cast<KeyServer*>(server_)->set_handshake_threads(threadCount, maxPending);
+		}
+	}
+
+	unsigned int KeyServerInterface::GetHandshakeQueueDepth()
+	{
+		if (!server_) return 0;
+
+		auto pool = is_ssl_ ?
+			reinterpret_cast<KeySSLServer*>(server_)->handshake_pool() :
+			reinterpret_cast<KeyServer*>(server_)->handshake_pool();
+		return pool ? static_cast<unsigned int>(pool->pending()) : 0;
+	}
+
+	void KeyServerInterface::GetHandshakeCounts(unsigned long long* fullHandshakes,
+		unsigned long long* resumedHandshakes, unsigned long long* failedHandshakes)
+	{
+		if (!server_) return;
+
+		auto metrics = is_ssl_ ?
+			reinterpret_cast<KeySSLServer*>(server_)->get_handshake_metrics() :
+			reinterpret_cast<KeyServer*>(server_)->get_handshake_metrics();
+		if (fullHandshakes) *fullHandshakes = metrics->full.value();
+		if (resumedHandshakes) *resumedHandshakes = metrics->resumed.value();
+		if (failedHandshakes) *failedHandshakes = metrics->failed.value();
+	}
+
+	void KeyServerInterface::SetKernelTLS(bool enable)
+	{
+		if (!server_) return;
+
+		if (is_ssl_) {
+			reinterpret_cast<KeySSLServer*>(server_)->set_ktls(enable);
+		}
+		else {
+			reinterpret_cast<KeyServer*>(server_)->set_ktls(enable);
+		}
+	}
+
+	void KeyServerInterface::GetKernelTLSCounts(unsigned long long* sendSessions,
+		unsigned long long* receiveSessions, unsigned long long* fallbackSessions)
+	{
+		if (!server_) return;
+
+		auto metrics = is_ssl_ ?
+			reinterpret_cast<KeySSLServer*>(server_)->get_handshake_metrics() :
+			reinterpret_cast<KeyServer*>(server_)->get_handshake_metrics();
+		if (sendSessions) *sendSessions = metrics->ktls_send.value();
+		if (receiveSessions) *receiveSessions = metrics->ktls_receive.value();
+		if (fallbackSessions) *fallbackSessions = metrics->ktls_fallback.value();
+	}
+
+	void KeyServerInterface::SetCompression(bool enable, unsigned int windowBits, unsigned int memoryLevel,
+		bool noContextTakeover, unsigned int threshold)
+	{
+		if (!server_) return;
+
+		compression_options options;
+		options.enable = enable;
+		options.server_max_window_bits = static_cast<int>(windowBits);
+		options.client_max_window_bits = static_cast<int>(windowBits);
+		options.server_no_context_takeover = noContextTakeover;
+		options.client_no_context_takeover = noContextTakeover;
+		options.memory_level = static_cast<int>(memoryLevel);
+		options.threshold = threshold;
+		if (is_ssl_) {
+			reinterpret_cast<KeySSLServer*>(server_)->set_compression(options);
+		}
+		else {
+			reinterpret_cast<KeyServer*>(server_)->set_compression(options);
+		}
+	}
+
+	void KeyServerInterface::GetCompressionCounts(unsigned long long* messages, unsigned long long* payloadBytes,
+		unsigned long long* wireBytes, unsigned long long* cpuMicroseconds)
+	{
+		if (!server_) return;
+
+		auto metrics = is_ssl_ ?
+			reinterpret_cast<KeySSLServer*>(server_)->get_compression_metrics() :
+			reinterpret_cast<KeyServer*>(server_)->get_compression_metrics();
+		if (messages) *messages = metrics->messages.value();
+		if (payloadBytes) *payloadBytes = metrics->payload_bytes.value();
+		if (wireBytes) *wireBytes = metrics->wire_bytes.value();
+		if (cpuMicroseconds) *cpuMicroseconds = metrics->cpu_ns.value() / 1000;
+	}
+
+	void KeyServerInterface::SetValidationThreads(unsigned int threadCount, unsigned int maxQueued)
+	{
+		if (!server_) return;
+
+		if (is_ssl_) {
+			reinterpret_cast<KeySSLServer*>(server_)->set_validation_threads(threadCount, maxQueued);
+		}
+		else {
+			reinterpret_cast<KeyServer*>(server_)->set_validation_threads(threadCount, maxQueued);
+		}
+	}
+
+	void KeyServerInterface::GetValidationCounts(unsigned int* queued, unsigned long long* jobs,
+		unsigned long long* waitMicroseconds, unsigned long long* inlineRuns)
+	{
+		if (!server_) return;
+
+		auto metrics = is_ssl_ ?
+			reinterpret_cast<KeySSLServer*>(server_)->get_validation_metrics() :
+			reinterpret_cast<KeyServer*>(server_)->get_validation_metrics();
+		if (queued) *queued = static_cast<unsigned int>(std::max<int64_t>(0, metrics->queued.value()));
+		if (jobs) *jobs = metrics->jobs.value();
+		if (waitMicroseconds) *waitMicroseconds = metrics->wait_ns.value() / 1000;
+		if (inlineRuns) *inlineRuns = metrics->inline_runs.value();
+	}
+
+	void KeyServerInterface::SetReplay(unsigned int capacity)
+	{
+		if (!server_) return;
+
+		if (is_ssl_) {
+			reinterpret_cast<KeySSLServer*>(server_)->set_replay(capacity);
+		}
+		else {
+			reinterpret_cast<KeyServer*>(server_)->set_replay(capacity);
+		}
+	}
+
 	void KeyServerInterface::SetListener(const char* address, unsigned short port)
 	{
 		if (!server_) return;
@@ -16,13 +16,44 @@ namespace websocket {
 		bool Start(size_t requestThreads);
 		void Stop();
 
+		size_t Broadcast(const char* data, unsigned int dataLen);
+		size_t BroadcastEx(const char* data, unsigned int dataLen,
+			int frameType, OnRelease onRelease, void* classObject = nullptr);
+		size_t Publish(const char* topic, const char* data, unsigned int dataLen, int frameType);
+
 		void RegisterOnJoin(OnJoin onJoin, void* classObject = nullptr);
 		void RegisterOnLeave(OnLeave onLeave, void* classObject = nullptr);
 		void RegisterOnData(OnData onData, void* classObject = nullptr);
 		void RegisterOnError(OnError onError, void* classObject = nullptr);
 		void RegisterOnValidate(OnValidate onValidate, void* classObject = nullptr);
 
+		bool ReloadCertificate();
+		void SetCertificateWatch(unsigned int intervalSeconds);
 		void SetKey(const char* key);
+		void SetIdleTimeout(unsigned int idleSeconds);
+		void SetPingInterval(unsigned int pingSeconds);
+		void SetThreadPerCore(bool enable);
+		void SetAdmissionLimits(unsigned int maxConnections, unsigned int maxPerIp,
+			unsigned int maxPendingHandshakes, unsigned int acceptRate);
+		void GetSocketOptions(WSSocketOptions& options);
+		void SetSocketOptions(const WSSocketOptions& options);
+		void SetTLSResumption(unsigned int cacheSize, unsigned int timeoutSeconds,
+			bool enableTickets, unsigned int ticketKeyRotationSeconds);
+		void SetHandshakeThreads(unsigned int threadCount, unsigned int maxPending);
+		unsigned int GetHandshakeQueueDepth();
+		void GetHandshakeCounts(unsigned long long* fullHandshakes,
+			unsigned long long* resumedHandshakes, unsigned long long* failedHandshakes);
+		void SetKernelTLS(bool enable);
+		void GetKernelTLSCounts(unsigned long long* sendSessions,
+			unsigned long long* receiveSessions, unsigned long long* fallbackSessions);
+		void SetCompression(bool enable, unsigned int windowBits, unsigned int memoryLevel,
+			bool noContextTakeover, unsigned int threshold);
+		void GetCompressionCounts(unsigned long long* messages, unsigned long long* payloadBytes,
+			unsigned long long* wireBytes, unsigned long long* cpuMicroseconds);
+		void SetReplay(unsigned int capacity);
+		void SetValidationThreads(unsigned int threadCount, unsigned int maxQueued);
+		void GetValidationCounts(unsigned int* queued, unsigned long long* jobs,
+			unsigned long long* waitMicroseconds, unsigned long long* inlineRuns);
 		void SetListener(const char* address, unsigned short port);
 		void SetCertificate(const char* certificateFile, const char* privateKeyFile);
 	};